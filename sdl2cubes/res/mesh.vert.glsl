@@ -0,0 +1,45 @@
+#version 330
+
+layout(std140) uniform FrameParams {
+    mat4 projection;    // viewspace to projection/clip space
+    float time;
+    mat4 view;
+    int firstObject;    // texel of the pass's first ObjectParams
+};
+
+// The pass's ObjectParams, one object to viewspace transform in four texels
+// each, see OBJECT_TEXELS in demo.c.
+uniform samplerBuffer objects;
+// Multi-draws give each draw its own base instance and leave this at 0,
+// other draws start the instance number from 0 and set it instead.
+uniform int baseInstance;
+
+// Declare vertex attribute inputs.
+// This should match what was done with glVertexAttribPointer.
+layout(location=0) in vec3 aPos;
+layout(location=1) in vec2 aTex;
+layout(location=2) in vec3 aNormal;
+// the draw's base instance plus the instance number, see meshbuffer.c
+layout(location=3) in uint aInstance;
+
+// These are passed to next shader stage.
+out vec2 vertexT;
+out vec3 vertexN;
+
+void main() {
+    int texel = firstObject + 4 * (baseInstance + int(aInstance));
+    mat4 transform = mat4(texelFetch(objects, texel),
+                          texelFetch(objects, texel + 1),
+                          texelFetch(objects, texel + 2),
+                          texelFetch(objects, texel + 3));
+    // flip texture so we don't have to do it in C.
+    vertexT = aTex * vec2(1.0, -1.0);
+    // Cutting the matrix down like this removes the translation,
+    // but if the modelview matrix shears or otherwise mangles coordinates
+    // beyond translating, uniform scaling and rotating this may be wrong.
+    // The correct normal/rotation-only transform would be the transpose of
+    // the inverted transform matrix, but that's a bit expensive to do here.
+    vertexN = normalize(mat3(transform) * aNormal);
+    // Apply transformations to project mesh-space vertex positions to screen.
+    gl_Position = projection * (transform * vec4(aPos, 1.0));
+}
@@ -0,0 +1,48 @@
+#version 330
+
+// Moves objects along their orbits in the scene, see getOrbit() in demo.c.
+// Each instance reads its orbit from a buffer that is only written once, so
+// animating the scene takes no CPU time and no uploads. It's drawn with
+// mesh.frag.glsl.
+
+layout(std140) uniform FrameParams {
+    mat4 projection;
+    float time;
+    mat4 view;
+};
+
+// (phase, speed, radius, z) of each instance's orbit
+uniform samplerBuffer orbits;
+
+layout(location=0) in vec3 aPos;
+layout(location=1) in vec2 aTex;
+layout(location=2) in vec3 aNormal;
+
+out vec2 vertexT;
+out vec3 vertexN;
+
+// same as tfRotate()
+mat4 rotation(float angle, vec3 v) {
+    float c = cos(angle), s = sin(angle), r = 1.0 - c;
+    return mat4(r * v.x * v.x + c, r * v.y * v.x + v.z * s,
+                r * v.x * v.z - v.y * s, 0.0,
+                r * v.x * v.y - v.z * s, r * v.y * v.y + c,
+                r * v.y * v.z + v.x * s, 0.0,
+                r * v.x * v.z + v.y * s, r * v.y * v.z - v.x * s,
+                r * v.z * v.z + c, 0.0,
+                0.0, 0.0, 0.0, 1.0);
+}
+
+void main() {
+    vec4 orbit  = texelFetch(orbits, gl_InstanceID);
+    float angle = orbit.x + time * orbit.y;
+    mat4 place  = mat4(0.5, 0.0, 0.0, 0.0,  0.0, 0.5, 0.0, 0.0,
+                       0.0, 0.0, 0.5, 0.0,
+                       cos(angle) * orbit.z, sin(angle) * orbit.z,
+                       orbit.w, 1.0);
+    mat4 transform = view * place *
+                     rotation(-time * 0.5, vec3(0.0, sqrt(0.5), sqrt(0.5)));
+    vertexT = aTex * vec2(1.0, -1.0);
+    vertexN = normalize(mat3(transform) * aNormal);
+    gl_Position = projection * (transform * vec4(aPos, 1.0));
+}
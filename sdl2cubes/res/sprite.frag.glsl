@@ -0,0 +1,11 @@
+#version 330
+
+in vec2 corner;
+in float fade;
+
+layout(location=0) out vec4 outColor;
+
+void main() {
+    float glow = max(0.0, 1.0 - dot(corner, corner));
+    outColor = vec4(1.0, 0.6, 0.2, 1.0) * glow * fade;
+}
@@ -0,0 +1,23 @@
+#version 330
+
+// Billboards for CPU particles. Each instance is a particle's position and
+// fade, and the corners of the quad come from the vertex number.
+
+layout(std140) uniform FrameParams {
+    mat4 projection;
+    float time;
+    mat4 view;
+};
+
+layout(location=0) in vec4 aParticle; // (x, y, z, fade)
+
+out vec2 corner;
+out float fade;
+
+void main() {
+    corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+    vec4 pos = view * vec4(aParticle.xyz, 1.0);
+    pos.xy += corner * 0.04;
+    fade = aParticle.w;
+    gl_Position = projection * pos;
+}
@@ -0,0 +1,113 @@
+/**
+ * arena.c
+ * Per-frame bump allocator.
+ *
+ * If a frame needs more memory than its block has, the rest comes from
+ * malloc and is freed on the block's next reset, which also grows the
+ * block to fit. After the first few frames everything fits and there are
+ * no heap allocations at all.
+ */
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+// freed memory is filled with this when poisoning
+enum { POISON_BYTE = 0xcd };
+
+typedef struct ArenaOverflow {
+    struct ArenaOverflow *next;
+    size_t size; // bytes after the header
+} ArenaOverflow;
+
+// Keep whatever follows a header aligned for anything.
+static const size_t HEADER_SIZE = (sizeof(ArenaOverflow) + 15) & ~(size_t)15;
+
+static void *alignPointer(unsigned char *p, size_t align) {
+    uintptr_t addr = (uintptr_t)p;
+    return p + ((align - addr % align) % align);
+}
+
+void arenaInit(Arena *arena, const char *name, size_t size, unsigned frames) {
+    assert(frames > 0 && frames <= ARENA_MAX_FRAMES);
+    memset(arena, 0, sizeof(Arena));
+    arena->frames = frames;
+    arena->name   = name;
+    for(unsigned i = 0; i < frames; i++) {
+        arena->blocks[i].base = (unsigned char *)malloc(size);
+        arena->blocks[i].size = size;
+    }
+}
+
+static void freeOverflow(ArenaBlock *block, int poison) {
+    ArenaOverflow *extra = block->overflow;
+    while(extra) {
+        ArenaOverflow *next = extra->next;
+        if(poison) {
+            memset((unsigned char *)extra + HEADER_SIZE, POISON_BYTE,
+                   extra->size);
+        }
+        free(extra);
+        extra = next;
+    }
+    block->overflow = NULL;
+}
+
+void arenaFree(Arena *arena) {
+    for(unsigned i = 0; i < arena->frames; i++) {
+        freeOverflow(&arena->blocks[i], 0);
+        free(arena->blocks[i].base);
+    }
+    memset(arena, 0, sizeof(Arena));
+}
+
+void *arenaAlloc(Arena *arena, size_t size, size_t align) {
+    assert(align > 0 && (align & (align - 1)) == 0);
+    ArenaBlock *block = &arena->blocks[arena->current];
+    block->demand += size + align - 1;
+    if(block->demand > arena->highWater) {
+        arena->highWater = block->demand;
+    }
+
+    unsigned char *top = block->base + block->used;
+    unsigned char *p   = (unsigned char *)alignPointer(top, align);
+    if(p + size <= block->base + block->size) {
+        block->used = (size_t)(p + size - block->base);
+        return p;
+    }
+    // Doesn't fit. Get the memory elsewhere for now; the next reset makes
+    // the block big enough.
+    size_t extraSize     = size + align - 1;
+    ArenaOverflow *extra = (ArenaOverflow *)malloc(HEADER_SIZE + extraSize);
+    extra->next          = block->overflow;
+    extra->size          = extraSize;
+    block->overflow      = extra;
+    return alignPointer((unsigned char *)extra + HEADER_SIZE, align);
+}
+
+void arenaReset(Arena *arena) {
+    arena->current    = (arena->current + 1) % arena->frames;
+    ArenaBlock *block = &arena->blocks[arena->current];
+
+    freeOverflow(block, arena->poison);
+    if(block->demand > block->size) {
+        size_t size = block->size ? block->size : 4096;
+        while(size < block->demand) {
+            size *= 2;
+        }
+        free(block->base);
+        block->base = (unsigned char *)malloc(size);
+        block->size = size;
+        block->used = 0;
+        printf("%s arena grown to %lu KiB\n", arena->name,
+               (unsigned long)(size >> 10));
+    }
+    if(arena->poison) {
+        memset(block->base, POISON_BYTE, block->used);
+    }
+    block->used   = 0;
+    block->demand = 0;
+}
@@ -0,0 +1,42 @@
+#ifndef CUBES_ARENA_H
+#define CUBES_ARENA_H
+
+#include <stddef.h>
+
+// Linear allocator for short-lived data. Allocating just bumps a pointer,
+// and everything is freed at once when the arena is reset.
+// An arena can be double (or triple) buffered: with frames set to 2, memory
+// allocated after one reset stays valid until two more resets have passed,
+// so data can outlive the frame that made it, e.g. while the GPU or another
+// thread is still reading it.
+
+enum { ARENA_MAX_FRAMES = 3 };
+
+// memory for one frame's allocations
+typedef struct ArenaBlock {
+    unsigned char *base;
+    size_t size;   // bytes at base
+    size_t used;   // bytes handed out from base
+    size_t demand; // bytes requested since the reset, including overflow
+    struct ArenaOverflow *overflow; // allocations that didn't fit
+} ArenaBlock;
+
+typedef struct Arena {
+    ArenaBlock blocks[ARENA_MAX_FRAMES];
+    unsigned frames;  // number of blocks in use
+    unsigned current; // block allocations come from
+    size_t highWater; // most bytes requested between resets
+    int poison;       // fill freed memory with garbage to catch stale use
+    const char *name; // for log messages
+} Arena;
+
+// set up an arena with size bytes per frame, for frames frames
+void arenaInit(Arena *arena, const char *name, size_t size, unsigned frames);
+// free all of the arena's memory
+void arenaFree(Arena *arena);
+// allocate size bytes aligned to align (a power of two); never fails
+void *arenaAlloc(Arena *arena, size_t size, size_t align);
+// start a new frame, freeing the allocations of the oldest one
+void arenaReset(Arena *arena);
+
+#endif
@@ -101,3 +101,57 @@ int arRead(AudioReader *ar, unsigned char *dest, int len) {
     } while(result && (len - ofs));
     return ofs;
 }
+
+static void putLE(unsigned char *dest, unsigned long value, int bytes) {
+    for(int i = 0; i < bytes; i++) {
+        dest[i] = (unsigned char)(value >> (i * 8));
+    }
+}
+
+int arWriteWAV(AudioReader *ar, const char *filename, double seconds) {
+    FILE *file = fopen(filename, "wb");
+    if(!file) {
+        fprintf(stderr, "error: can't open %s for writing\n", filename);
+        return 0;
+    }
+    // arRead() gives 16-bit samples, interleaved.
+    unsigned long rate      = arGetRate(ar);
+    unsigned long frameSize = arGetChannels(ar) * 2;
+    unsigned long dataSize  = (unsigned long)(seconds * rate) * frameSize;
+
+    unsigned char header[44];
+    memcpy(header, "RIFF", 4);
+    putLE(header + 4, 36 + dataSize, 4);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    putLE(header + 16, 16, 4);                // format chunk size
+    putLE(header + 20, 1, 2);                 // PCM
+    putLE(header + 22, frameSize / 2, 2);     // channels
+    putLE(header + 24, rate, 4);              // samples per second
+    putLE(header + 28, rate * frameSize, 4);  // bytes per second
+    putLE(header + 32, frameSize, 2);         // bytes per sample frame
+    putLE(header + 34, 16, 2);                // bits per sample
+    memcpy(header + 36, "data", 4);
+    putLE(header + 40, dataSize, 4);
+    int ok = fwrite(header, sizeof(header), 1, file) == 1;
+
+    unsigned char buffer[16384];
+    unsigned long done = 0;
+    int ended          = 0;
+    while(ok && done < dataSize) {
+        int len = (int)(dataSize - done < sizeof(buffer) ? dataSize - done
+                                                         : sizeof(buffer));
+        int got = ended ? 0 : arRead(ar, buffer, len);
+        if(got < len) {
+            memset(buffer + got, 0, len - got);
+            ended = 1;
+        }
+        ok = fwrite(buffer, len, 1, file) == 1;
+        done += len;
+    }
+    if(fclose(file) != 0 || !ok) {
+        fprintf(stderr, "error: can't write %s\n", filename);
+        return 0;
+    }
+    printf("wrote %.1f s of audio to %s\n", seconds, filename);
+    return 1;
+}
@@ -15,5 +15,8 @@ int arGetChannels(AudioReader *ar);
 int arGetSampleBits(AudioReader *ar);
 // try to read audio from source; return number of bytes acquired
 int arRead(AudioReader *ar, unsigned char *dest, int len);
+// decode the next seconds of audio into a 16-bit WAV file, padding it with
+// silence if the source ends early; return 0 on failure
+int arWriteWAV(AudioReader *ar, const char *filename, double seconds);
 
 #endif
@@ -0,0 +1,108 @@
+/**
+ * benchmark.c
+ * Frame statistics for benchmark runs.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "benchmark.h"
+
+#ifdef WINDOWS
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+void bmInit(Benchmark *bm, unsigned frames) {
+    memset(bm, 0, sizeof(Benchmark));
+    bm->millis   = (float *)malloc(sizeof(float) * (frames ? frames : 1));
+    bm->capacity = frames;
+}
+
+void bmFree(Benchmark *bm) {
+    free(bm->millis);
+    bm->millis = NULL;
+}
+
+int bmAddFrame(Benchmark *bm, float millis, unsigned drawCalls,
+               unsigned uploadBytes) {
+    if(bm->warmup < BM_WARMUP_FRAMES) {
+        bm->warmup++;
+    } else if(bm->frames < bm->capacity) {
+        bm->millis[bm->frames++] = millis;
+        bm->drawCalls += drawCalls;
+        bm->uploadBytes += uploadBytes;
+        if(drawCalls > bm->maxDrawCalls) {
+            bm->maxDrawCalls = drawCalls;
+        }
+    }
+    return bm->frames == bm->capacity;
+}
+
+static int compareFloats(const void *a, const void *b) {
+    float x = *(const float *)a, y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+// Get the time that a fraction of the sorted frames are at or under.
+static float percentile(const float *sorted, unsigned count,
+                        float fraction) {
+    unsigned rank = (unsigned)(fraction * count + 0.999f);
+    if(rank < 1) {
+        rank = 1;
+    }
+    return sorted[(rank < count ? rank : count) - 1];
+}
+
+BenchmarkStats bmGetStats(const Benchmark *bm) {
+    BenchmarkStats stats;
+    memset(&stats, 0, sizeof(stats));
+    unsigned count = bm->frames;
+    if(!count) {
+        return stats;
+    }
+    float *sorted = (float *)malloc(sizeof(float) * count);
+    memcpy(sorted, bm->millis, sizeof(float) * count);
+    qsort(sorted, count, sizeof(float), compareFloats);
+
+    double sum = 0;
+    for(unsigned i = 0; i < count; i++) {
+        sum += sorted[i];
+    }
+    stats.frames           = count;
+    stats.seconds          = sum / 1000;
+    stats.mean             = (float)(sum / count);
+    stats.min              = sorted[0];
+    stats.p50              = percentile(sorted, count, 0.50f);
+    stats.p90              = percentile(sorted, count, 0.90f);
+    stats.p95              = percentile(sorted, count, 0.95f);
+    stats.p99              = percentile(sorted, count, 0.99f);
+    stats.max              = sorted[count - 1];
+    stats.drawCalls        = bm->drawCalls / count;
+    stats.maxDrawCalls     = bm->maxDrawCalls;
+    stats.uploadBytes      = bm->uploadBytes / count;
+    stats.totalUploadBytes = bm->uploadBytes;
+    free(sorted);
+    return stats;
+}
+
+size_t bmPeakRSS() {
+#ifdef WINDOWS
+    PROCESS_MEMORY_COUNTERS counters;
+    if(GetProcessMemoryInfo(GetCurrentProcess(), &counters,
+                            sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+#else
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef __APPLE__
+        return (size_t)usage.ru_maxrss; // in bytes on macOS
+#else
+        return (size_t)usage.ru_maxrss * 1024; // in KiB elsewhere
+#endif
+    }
+#endif
+    return 0;
+}
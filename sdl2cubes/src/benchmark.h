@@ -0,0 +1,46 @@
+#ifndef CUBES_BENCHMARK_H
+#define CUBES_BENCHMARK_H
+
+#include <stddef.h>
+
+// Measurements of a --benchmark run. Unlike framestats.h, every frame's
+// time is kept, so the statistics cover the whole run exactly. The first
+// BM_WARMUP_FRAMES frames are left out, since they include shader
+// compiles, buffers growing to size and the driver settling down.
+
+enum { BM_WARMUP_FRAMES = 60 };
+
+typedef struct Benchmark {
+    float *millis;         // measured frame times, in order
+    unsigned capacity;     // frames to measure
+    unsigned frames;       // frames measured so far
+    unsigned warmup;       // warmup frames seen so far
+    double drawCalls;      // sum over the measured frames
+    unsigned maxDrawCalls; // most in one frame
+    double uploadBytes;    // sum over the measured frames
+} Benchmark;
+
+typedef struct BenchmarkStats {
+    unsigned frames;
+    double seconds;                           // sum of the frame times
+    float mean, min, p50, p90, p95, p99, max; // frame times in ms
+    double drawCalls;                         // mean per frame
+    unsigned maxDrawCalls;
+    double uploadBytes;      // mean per frame
+    double totalUploadBytes; // over the measured frames
+} BenchmarkStats;
+
+// prepare to measure frames frames after the warmup
+void bmInit(Benchmark *bm, unsigned frames);
+// free the frame times
+void bmFree(Benchmark *bm);
+// add a frame and what was drawn in it; return 1 once all are measured
+int bmAddFrame(Benchmark *bm, float millis, unsigned drawCalls,
+               unsigned uploadBytes);
+// get the statistics of the measured frames; percentiles use the nearest
+// rank
+BenchmarkStats bmGetStats(const Benchmark *bm);
+// get the most memory the process has had resident, in bytes; 0 if unknown
+size_t bmPeakRSS();
+
+#endif
@@ -9,13 +9,35 @@
 #include "image.h"
 #include "shaders.h"
 #include "audio.h"
+#include "dynres.h"
 #include "mesh_obj.h"
+#include "arena.h"
+#include "dsa.h"
+#include "glstate.h"
+#include "gputimer.h"
+#include "jobs.h"
+#include "meshbuffer.h"
+#include "overlay.h"
+#include "particlepool.h"
+#include "particles.h"
+#include "perfgraph.h"
+#include "renderqueue.h"
+#include "ringbuffer.h"
+#include "rtpool.h"
+#include "trace.h"
 #include "transform.h"
+#include "uniforms.h"
 
 const char *WINDOW_TITLE = "cubes!?";
 
 float g_time = 0;
 
+// view frustum depth range
+const float Z_NEAR = 0.1f;
+const float Z_FAR  = 5000.0f;
+// vertical field of view
+const float FOV_Y = M_PI * 0.3f;
+
 // These can be passed to shaders as-is, as long as they match GLSL's layout
 // rules. Basically things are aligned to their size, except that
 // vec3 aligns like vec4 and matrices align to their column size
@@ -24,41 +46,136 @@ float g_time = 0;
 typedef struct FrameParams {
     Transform projection;
     float time;
+    float padding[3]; // a mat4 starts at a multiple of 16 bytes
+    Transform view;   // camera transform
+    int firstObject;  // texel of the pass's first ObjectParams
+    int padding2[3];
 } FrameParams;
 
 typedef struct ObjectParams { Transform transform; } ObjectParams;
 
+// Queued objects: their draws and parameters, in queueing order.
+// The parameters are staged here instead of being written straight into
+// the uniform ring. Objects are queued by the traversal jobs and, with
+// --pipeline, on the logic thread, neither of which may touch GL. The
+// ring's order has to be the sorted draw order, so that each run of
+// instances reads consecutive transforms, and that's only known after
+// sorting. uploadPass() copies them over in one write per pass.
+typedef struct ObjectQueue {
+    RenderQueue draws;
+    ObjectParams *params;
+    unsigned capacity; // number of params there's space for
+    int logGrowth;     // print a message when the queue grows
+} ObjectQueue;
+
+// Everything the logic stage hands to the render stage for one frame.
+// With --pipeline, the logic thread fills one packet while the render
+// thread draws the other (see main.c), so the render stage only reads
+// what's in its packet and never the logic stage's globals.
+typedef struct FramePacket {
+    FrameParams fp;
+    float dt;            // time since the last frame
+    int paused;          // if set, time stood still anyway
+    ObjectQueue objects; // the scene's objects, sorted for drawing
+    GLuint program;      // mesh shader to queue the objects with
+    double logicMillis;  // CPU time the logic stage took
+} FramePacket;
+
+// Meshes read their ObjectParams from a buffer texture over the uniform
+// ring, which has no size limit like uniform blocks do. Each one takes
+// this many RGBA32F texels.
+enum { OBJECT_TEXELS = sizeof(ObjectParams) / 16 };
+enum { OBJECT_QUEUE_SIZE = 1024 }; // initial capacity of object queues
+
 // GL 3.3 Core does not have the older versions' built-in transformation matrix
 // stacks, so this program has to implement something similar on its own.
 Transform g_tfProjection;  // current projection transform
 TransformStack *g_tfsView; // model/view transform
 
-typedef struct RenderMesh {
-    GLuint vertexArray; // vertex array object id
-    GLuint buffer;      // buffer object id
-    unsigned vertices;  // number of vertices
-} RenderMesh;
+FramePacket g_packets[FRAME_PACKETS]; // see updateDemo() and renderDemo()
+ObjectQueue *g_queue; // the packet queueObject() adds to
+
+// Scratch memory for this frame only. It's reset at the start of each
+// frame, so nothing allocated from it may be kept around.
+Arena g_frameArena;
+
+// Big scenes are traversed in chunks on all threads. Each thread gets a
+// few chunks, which evens out differences in their speed.
+enum { CHUNKS_PER_THREAD = 4 };
+enum { MAX_SCENE_CHUNKS = JOBS_MAX_THREADS * CHUNKS_PER_THREAD };
+
+ObjectQueue g_objectChunks[MAX_SCENE_CHUNKS];  // objects queued by chunks
+TransformStack *g_tfsChunks[MAX_SCENE_CHUNKS]; // chunks' transform stacks
 
 // ---- GL resources ----
 
-GLuint g_vaQuad    = 0; // vertex array for the quad
-GLuint g_bufQuad   = 0; // data buffer for the quad
-GLuint g_ubGlobals = 0; // uniform buffer for per-frame data
-GLuint g_ubObjects = 0; // uniform buffer for per-object data
+GLuint g_vaQuad  = 0; // vertex array for the quad
+GLuint g_bufQuad = 0; // data buffer for the quad
+
+MeshBuffer g_meshBuffer; // storage for all static meshes
+
+RingBuffer *g_ringUniforms = NULL; // uniform data of all passes
+RingBuffer *g_ringCommands = NULL; // indirect draw commands
+
+// The uniform ring should hold several frames of a large scene. It grows
+// if a pass's data doesn't fit in half of it.
+enum { UNIFORM_RING_SIZE = 16 << 20 };
+// Objects are read from the ring through a buffer texture, which only
+// reaches GL_MAX_TEXTURE_BUFFER_SIZE texels, so the ring mustn't outgrow
+// that. Passes with more objects are uploaded and drawn in parts of at
+// most this many, see initBuffers().
+unsigned g_maxPassObjects = 0;
+
+// The scene is rendered to an offscreen target from rtpool.c for effects.
+// When the window is resized, the target keeps its size and the scene is
+// stretched over it until the window has stayed the same size for
+// RESIZE_SETTLE_FRAMES frames, so dragging the window's edge doesn't
+// allocate a new target on every step.
+enum { RESIZE_SETTLE_FRAMES = 8 };
+int g_targetWidth       = 0; // size of the offscreen target
+int g_targetHeight      = 0;
+unsigned g_resizeFrames = 0; // frames since the window was last resized
 
-GLuint g_fbOffscreen  = 0; // offscreen render target for effects
-GLuint g_texOffscreen = 0; // offscreen render target's color texture
-GLuint g_rbOffscreen  = 0; // offscreen render target's depth buffer
 GLuint g_texTest      = 0; // test texture
-GLuint g_texAtlas     = 0; // overlay graphics
-GLuint g_shaderMesh   = 0; // shader for simple meshes
+GLuint g_texAtlas     = 0; // overlay graphics, see overlay.c
 GLuint g_shaderPostFX = 0; // shader for simple meshes
+GLint g_locUVScale    = -1; // its uvScale uniform
+DynamicResolution g_dynres; // picks g_renderScale
+float g_renderScale = 1;    // share of the offscreen target rendered to
 RenderMesh g_meshCube;     // mesh object
+RenderMesh g_sceneMeshes[MAX_SCENE_MESHES]; // meshes of the scene's objects
+unsigned g_numSceneMeshes = 0;
+
+ParticleSystem *g_fountains = NULL; // GPU particles, if enabled
+ParticlePool g_spray;                // CPU particles, if enabled
+RingBuffer *g_ringSprites = NULL;    // their positions, streamed
+GLuint g_vaSprites        = 0;       // vertex array for drawing them
+GLuint g_shaderSprite     = 0;       // shader for drawing them
+
+GLuint g_shaderMesh     = 0;  // shader for meshes
+GLint g_locBaseInstance = -1; // its baseInstance uniform
+GLuint g_shaderOrbit    = 0;  // shader for meshes animated on the GPU
+GLuint g_bufOrbits      = 0;  // orbits of the scene's objects
+GLuint g_texOrbits      = 0;  // buffer texture for reading them
+GLuint g_texObjects     = 0;  // buffer texture over g_ringUniforms
+GLuint g_texObjectsRing = 0;  // the ring's buffer it was made for
+unsigned g_drawCalls    = 0;  // draw calls issued during this frame
+unsigned g_uploadBytes  = 0;  // bytes streamed to the GPU last frame
+
+// GPU timer scopes of the frame's passes, see gputimer.c
+int g_timerFrame, g_timerScene, g_timerParticles, g_timerPost;
 
 void loadMesh(RenderMesh *dest, const char *filename);
 void loadTexture(GLuint *dest, const char *filename);
+void meshShaderCompiled(ShaderSourceSpec *spec);
+void postFXShaderCompiled(ShaderSourceSpec *spec);
+void orbitShaderCompiled(ShaderSourceSpec *spec);
 
 void initBuffers();
+void initOrbits();
+void initParticles();
+void initSpray();
+void initFrameTiming();
 void initRenderTargets();
 void drawQuad();
 
@@ -71,266 +188,1095 @@ int initDemo() {
     // This starts playing when init has finished.
     setSoundtrack("res/track.ogg");
 
+    arenaInit(&g_frameArena, "frame", 1 << 20, 1);
+    g_frameArena.poison = g_poisonArenas;
+
     g_tfProjection = tfIdentity();
     tfsCreate(&g_tfsView, 64);
+    for(int i = 0; i < MAX_SCENE_CHUNKS; i++) {
+        tfsCreate(&g_tfsChunks[i], 64);
+    }
 
+    mbInit(&g_meshBuffer, 1 << 16, 1 << 18, OBJECT_QUEUE_SIZE);
     loadMesh(&g_meshCube, "res/unitcube.obj");
+    for(unsigned i = 0; i < g_numSceneMeshFiles; i++) {
+        RenderMesh *mesh = &g_sceneMeshes[g_numSceneMeshes];
+        loadMesh(mesh, g_sceneMeshFiles[i]);
+        if(mesh->indices) {
+            g_numSceneMeshes++;
+        } else {
+            fprintf(stderr, "couldn't load %s, skipping it\n",
+                    g_sceneMeshFiles[i]);
+        }
+    }
+    if(!g_numSceneMeshes) {
+        g_sceneMeshes[g_numSceneMeshes++] = g_meshCube;
+    }
     loadTexture(&g_texTest, "res/quality_graphics.png");
 
-    addShaderSource(&g_shaderMesh, "res/mesh.vert.glsl", "res/mesh.frag.glsl",
-                    NULL, NULL);
     addShaderSource(&g_shaderPostFX, "res/postfx.vert.glsl",
-                    "res/postfx.frag.glsl", NULL, NULL);
+                    "res/postfx.frag.glsl", NULL, postFXShaderCompiled);
+    addShaderSource(&g_shaderMesh, "res/mesh.vert.glsl", "res/mesh.frag.glsl",
+                    NULL, meshShaderCompiled);
+    addShaderSource(&g_shaderOrbit, "res/orbit.vert.glsl",
+                    "res/mesh.frag.glsl", NULL, orbitShaderCompiled);
+    addShaderSource(&g_shaderSprite, "res/sprite.vert.glsl",
+                    "res/sprite.frag.glsl", NULL, NULL);
+    psInit();
+    ovInit();
 
     reloadShaders();
     initBuffers();
+    g_texAtlas = ovCreate(ringGetStats(g_ringUniforms).strategy);
+    if(g_gpuAnimation) {
+        initOrbits();
+    }
+    if(g_particles) {
+        initParticles();
+    }
+    if(g_cpuParticles) {
+        initSpray();
+    }
     initRenderTargets();
+    initFrameTiming();
+    drInit(&g_dynres, g_gpuBudget, DR_MIN_SCALE);
     return 1;
 }
 
 void resizeDemo() {
-    initRenderTargets();
+    g_resizeFrames = 0;
 }
 
-void updateShaderGlobals(FrameParams *gu);
-void drawScene();
-
-void queueObject(ObjectParams *params);
-void flushObjects();
+void updateDemo(int index, float dt);
+int renderDemo(int index);
+void queueScene(FramePacket *packet);
+void drawScene(FramePacket *packet);
+void drawParticles(float dt, float time);
+void drawSpray(float dt, float time);
+void drawOverlay();
+double millisBetween(Uint64 start, Uint64 end);
+void endFrameTiming(FramePacket *packet, Uint64 frameStart,
+                    Uint64 sceneEnd);
+
+void queueObject(ObjectParams *params, RenderMesh *mesh, GLuint program,
+                 GLuint texture);
+void queueObjectIn(ObjectQueue *queue, ObjectParams *params,
+                   RenderMesh *mesh, GLuint program, GLuint texture);
+void reserveObjects(ObjectQueue *queue, unsigned count);
+void sortObjects(ObjectQueue *queue);
+void flushObjects(FramePacket *packet);
 
 /**
- * Demo script and rendering goes here.
+ * Run the demo for one frame.
  * Return 0 to quit.
  */
 int runDemo(float dt) {
+    TRACE_BEGIN("runDemo");
+    updateDemo(0, dt);
+    int result = renderDemo(0);
+    TRACE_END();
+    return result;
+}
+
+/**
+ * Demo script goes here: advance time and decide what to draw into a
+ * frame packet. This must not touch GL; with --pipeline it runs on its own
+ * thread while the previous packet is drawn.
+ */
+void updateDemo(int index, float dt) {
+    TRACE_BEGIN("updateDemo");
+    Uint64 start        = SDL_GetPerformanceCounter();
+    FramePacket *packet = &g_packets[index];
     if(!g_paused) {
         g_time += dt;
     }
+    packet->dt     = dt;
+    packet->paused = g_paused;
+    arenaReset(&g_frameArena);
     // if our demo had a script, this would be a good point
     // to check if stuff is habbening
 
-    glBindFramebuffer(GL_FRAMEBUFFER, g_fbOffscreen);
-    glDepthMask(GL_TRUE);
-    glEnable(GL_CULL_FACE);
-    glEnable(GL_DEPTH_TEST);
+    FrameParams *fp = &packet->fp;
+    memset(fp, 0, sizeof(FrameParams));
+    fp->projection = tfPerspective(Z_NEAR, Z_FAR, g_aspect, FOV_Y);
+    fp->time       = g_time;
 
-    glClearColor(.2f, .2f, .2f, 0);
+    // ---- queue objects and stuff ----
+    tfsClear(g_tfsView); // reset transform stack
+    if(g_benchmark) {
+        // Sway and pull back through the rings and return every 20 s,
+        // depending on nothing but the time so every run sees the same.
+        float pull = 0.5f - 0.5f * cosf(g_time * (float)M_PI / 10);
+        tfsApply(g_tfsView, tfRotate(sinf(g_time * 0.3f) * 0.3f, 0, 1, 0));
+        tfsApply(g_tfsView, tfTranslate(0, 0, -5 + pull * 20));
+    } else {
+        tfsApply(g_tfsView, tfTranslate(0, 0, -5)); // position
+    }
+    fp->view = tfsGet(g_tfsView);
+
+    g_queue = &packet->objects;
+    queueScene(packet);
+    sortObjects(&packet->objects);
+    packet->logicMillis =
+        millisBetween(start, SDL_GetPerformanceCounter());
+    TRACE_END();
+}
+
+/**
+ * Rendering goes here: draw what updateDemo() put into a frame packet.
+ * Return 0 to quit.
+ */
+int renderDemo(int index) {
+    TRACE_BEGIN("renderDemo");
+    Uint64 frameStart   = SDL_GetPerformanceCounter();
+    FramePacket *packet = &g_packets[index];
+    float dt            = packet->paused ? 0 : packet->dt;
+    gtBegin(g_timerFrame);
+    g_drawCalls = 0;
+
+    if((g_targetWidth != g_windowWidth || g_targetHeight != g_windowHeight) &&
+       ++g_resizeFrames >= RESIZE_SETTLE_FRAMES) {
+        g_targetWidth  = g_windowWidth;
+        g_targetHeight = g_windowHeight;
+    }
+    RenderTarget *target = rtAcquire(g_targetWidth, g_targetHeight, GL_RGBA8);
+    if(!target) {
+        TRACE_END();
+        return 0;
+    }
+    // The scene is rendered to the lower left corner of the target, which
+    // is smaller than all of it with dynamic resolution or if the window
+    // has shrunk since the target was made.
+    int width  = g_windowWidth < target->width ? g_windowWidth
+                                               : target->width;
+    int height = g_windowHeight < target->height ? g_windowHeight
+                                                 : target->height;
+    width      = (int)(width * g_renderScale + 0.5f);
+    height     = (int)(height * g_renderScale + 0.5f);
+    width      = width > 0 ? width : 1;
+    height     = height > 0 ? height : 1;
+
+    gtBegin(g_timerScene);
+    gsBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+    gsViewport(0, 0, width, height);
+    gsDepthMask(GL_TRUE);
+    gsEnable(GL_CULL_FACE);
+    gsEnable(GL_DEPTH_TEST);
+
+    gsClearColor(.2f, .2f, .2f, 0);
     glClearDepth(1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    glUseProgram(g_shaderMesh);
-
-    FrameParams fp;
-    fp.projection = tfPerspective(0.1f, 5000.0f, g_aspect, M_PI * 0.3f);
-    fp.time = g_time;
-    updateShaderGlobals(&fp);
-
     // ---- draw objects and stuff ----
-    tfsClear(g_tfsView); // reset transform stack
-    // (this would be a good spot to position the camera)
-    tfsApply(g_tfsView, tfTranslate(0, 0, -5)); // position
-
-    drawScene();
+    drawScene(packet);
+    gtEnd(g_timerScene);
+    gtBegin(g_timerParticles);
+    drawParticles(dt, packet->fp.time);
+    drawSpray(dt, packet->fp.time);
+    gtEnd(g_timerParticles);
+    Uint64 sceneEnd = SDL_GetPerformanceCounter();
 
     // ---- postprocessing and overlays ---
-    glBindFramebuffer(GL_FRAMEBUFFER, 0); // disable offscreen render target
+    // The frame parameters the scene pass bound are still there for these.
+    gtBegin(g_timerPost);
+    gsBindFramebuffer(GL_FRAMEBUFFER, 0); // disable offscreen render target
+    gsViewport(0, 0, g_windowWidth, g_windowHeight);
 
-    glDisable(GL_DEPTH_TEST);
-    glDepthMask(GL_FALSE); // don't write depth so we don't have to clear it
+    gsDisable(GL_DEPTH_TEST);
+    gsDepthMask(GL_FALSE); // don't write depth so we don't have to clear it
 
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, g_texOffscreen); // use offscreen RT texture
-    glUseProgram(g_shaderPostFX);
+    gsBindTexture(0, GL_TEXTURE_2D, target->color); // offscreen RT texture
+    gsUseProgram(g_shaderPostFX);
+    glUniform2f(g_locUVScale, (float)width / target->width,
+                (float)height / target->height);
 
     drawQuad();
+    rtRelease(target);
+    drawOverlay();
+    gtEnd(g_timerPost);
+
+    // fence this frame's uniform data so it won't be overwritten too early
+    ringEndFrame(g_ringUniforms);
+    g_uploadBytes = ringGetStats(g_ringUniforms).frameBytes;
+    if(g_ringCommands) {
+        ringEndFrame(g_ringCommands);
+        g_uploadBytes += ringGetStats(g_ringCommands).frameBytes;
+    }
+    if(g_ringSprites) {
+        ringEndFrame(g_ringSprites);
+        g_uploadBytes += ringGetStats(g_ringSprites).frameBytes;
+    }
+    rtEndFrame();
+    endFrameTiming(packet, frameStart, sceneEnd);
+    TRACE_COUNTER("draw calls", g_drawCalls);
+    TRACE_COUNTER("upload KiB", g_uploadBytes / 1024.0);
 
+    TRACE_BEGIN("presentWindow");
     presentWindow(); // flip buffers
+    TRACE_END();
+    // F5 may have replaced the shader, so the packet's next objects are
+    // queued with the current one.
+    packet->program = g_shaderMesh;
+    TRACE_END();
     return 1;
 }
 
-void drawScene() {
-    // bind the test texture to sampler 0
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, g_texTest);
+// ---- scene ----
 
-    float t = g_time;
+// The scene is rings of cubes orbiting in front of the camera. The first
+// ring has the demo's original 20 cubes, and each ring after it has 20 more
+// than the one before and sits further out and further away. The number of
+// objects is set with --objects, so this doubles as a stress test.
+enum { RING_OBJECTS = 20 };
 
-    int NUM_CUBES = 20;
+// Scenes with at least this many objects are traversed on all threads.
+enum { PARALLEL_MIN_OBJECTS = 1024 };
+
+// What traversal jobs need to know about the frame. They run on worker
+// threads, so they must not touch GL or write to any shared state.
+typedef struct SceneJob {
+    Transform view; // camera transform
+    float time;
+    float tanX;     // tangent of half the horizontal field of view
+    float tanY;     // tangent of half the vertical field of view
+    GLuint program; // shader for the objects
+} SceneJob;
+
+// Get the index of the first object of a ring.
+unsigned getRingStart(unsigned ring) {
+    return RING_OBJECTS * ring * (ring + 1) / 2;
+}
+
+// Check if a sphere around the origin of a model/view transform is at least
+// partly inside the view frustum.
+int isVisible(SceneJob *job, Transform *tf, float radius) {
+    const float *m = tf->m;
+    // The transform's (uniform) scaling applies to the radius too.
+    float r = radius * sqrtf(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+    float x = m[12], y = m[13], d = -m[14];
+    if(d + r < Z_NEAR || d - r > Z_FAR) {
+        return 0;
+    }
+    // The side planes go through the eye, so their distance from the
+    // center is easy to find in view space.
+    if(fabsf(x) - d * job->tanX > r * sqrtf(1 + job->tanX * job->tanX) ||
+       fabsf(y) - d * job->tanY > r * sqrtf(1 + job->tanY * job->tanY)) {
+        return 0;
+    }
+    return 1;
+}
+
+// How the i'th object moves. res/orbit.vert.glsl reads this as a vec4 and
+// has to do the same math as queueSceneObjects().
+typedef struct Orbit {
+    float phase;  // angle at time 0
+    float speed;  // angular velocity
+    float radius; // distance from the orbit's center
+    float z;      // depth of the orbit's center
+} Orbit;
+
+Orbit getOrbit(unsigned i) {
+    // Solve the ring from getRingStart(ring) <= i, then fix rounding.
+    float root    = sqrtf(1 + 8.0f * i / RING_OBJECTS);
+    unsigned ring = (unsigned)((root - 1) / 2);
+    while(getRingStart(ring + 1) <= i) {
+        ring++;
+    }
+    while(getRingStart(ring) > i) {
+        ring--;
+    }
+    unsigned ringSize = RING_OBJECTS * (ring + 1);
+    float p           = (float)(i - getRingStart(ring)) / ringSize;
+
+    Orbit orbit;
+    orbit.phase  = p * M_PI * 2;
+    orbit.speed  = 0.2f / (1 + ring * 0.1f);
+    orbit.radius = 4.0f + ring;
+    orbit.z      = -10.0f - ring * 2.0f;
+    return orbit;
+}
+
+// Position the objects [first, first + count) on top of the stack and queue
+// the visible ones.
+void queueSceneObjects(SceneJob *job, unsigned first, unsigned count,
+                       ObjectQueue *queue, TransformStack *tfs) {
+    float t = job->time;
+    float s = 1.0 / sqrtf(2);
 
     ObjectParams objectParams;
-    for(int i = 0; i < NUM_CUBES; i++) {
-        float p = (float)i / NUM_CUBES;
+    for(unsigned i = first; i < first + count; i++) {
+        Orbit orbit = getOrbit(i);
+        float angle = orbit.phase + t * orbit.speed;
+
+        float x = cosf(angle) * orbit.radius;
+        float y = sinf(angle) * orbit.radius;
+        float z = orbit.z;
+
+        tfsPush(tfs);
+        tfsApply(tfs, tfTranslate(x, y, z));
+        tfsApply(tfs, tfScale(0.5f));
+        tfsApply(tfs, tfRotate(-t * 0.5f, 0, s, s));
+
+        objectParams.transform = tfsGet(tfs);
+        RenderMesh *mesh       = &g_sceneMeshes[i % g_numSceneMeshes];
+        if(isVisible(job, &objectParams.transform, mesh->radius)) {
+            queueObjectIn(queue, &objectParams, mesh, job->program,
+                          g_texTest);
+        }
+        tfsPop(tfs);
+    }
+}
+
+// Traverse one chunk of the scene into the chunk's own queue.
+void queueSceneChunk(void *data, unsigned first, unsigned count,
+                     unsigned chunk) {
+    SceneJob *job       = (SceneJob *)data;
+    TransformStack *tfs = g_tfsChunks[chunk];
+    tfsClear(tfs);
+    tfsApply(tfs, job->view);
+    queueSceneObjects(job, first, count, &g_objectChunks[chunk], tfs);
+}
+
+// Where mergeSceneChunk() copies each chunk's objects.
+typedef struct MergeJob {
+    ObjectQueue *dest;
+    unsigned offsets[MAX_SCENE_CHUNKS];
+} MergeJob;
+
+// Copy one chunk's objects to their place in the packet's queue.
+void mergeSceneChunk(void *data, unsigned first, unsigned count,
+                     unsigned chunk) {
+    (void)first;
+    (void)count;
+    MergeJob *job     = (MergeJob *)data;
+    ObjectQueue *src  = &g_objectChunks[chunk];
+    ObjectQueue *dest = job->dest;
+    unsigned offset   = job->offsets[chunk];
+    RenderItem *items = dest->draws.items + offset;
+    unsigned numItems = src->draws.count;
+    for(unsigned i = 0; i < numItems; i++) {
+        items[i] = src->draws.items[i];
+        items[i].transform += offset;
+    }
+    memcpy(dest->params + offset, src->params,
+           sizeof(ObjectParams) * numItems);
+    src->draws.count = 0;
+}
+
+// Draw the whole scene with one instanced draw that the vertex shader
+// animates. There's no culling, so every object is drawn, all with the
+// first of the scene's meshes.
+void drawOrbits() {
+    RenderMesh *mesh = &g_sceneMeshes[0];
+    gsUseProgram(g_shaderOrbit);
+    gsBindVertexArray(g_meshBuffer.plainVertexArray);
+    gsBindTexture(0, GL_TEXTURE_2D, g_texTest);
+    gsBindTexture(1, GL_TEXTURE_BUFFER, g_texOrbits);
+    glDrawElementsInstancedBaseVertex(
+        GL_TRIANGLES, mesh->indices, GL_UNSIGNED_INT,
+        (void *)(sizeof(GLuint) * mesh->firstIndex), g_sceneObjects,
+        mesh->baseVertex);
+    g_drawCalls++;
+}
+
+// Upload the orbits of the scene's objects for drawOrbits(). They never
+// change, so this only happens once.
+void initOrbits() {
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    if(g_sceneObjects > (unsigned)maxTexels) {
+        printf("warning: too many objects to animate on the GPU\n");
+        g_gpuAnimation = 0;
+        return;
+    }
+    Orbit *orbits = (Orbit *)malloc(sizeof(Orbit) * g_sceneObjects);
+    for(unsigned i = 0; i < g_sceneObjects; i++) {
+        orbits[i] = getOrbit(i);
+    }
+    g_bufOrbits = dsaCreateBuffer(GL_TEXTURE_BUFFER);
+    dsaBufferData(g_bufOrbits, sizeof(Orbit) * g_sceneObjects, orbits,
+                  GL_STATIC_DRAW);
+    free(orbits);
+    g_texOrbits = dsaCreateTextureBuffer(GL_RGBA32F, g_bufOrbits);
+    printf("animating %u objects on the GPU\n", g_sceneObjects);
+}
 
-        float avel  = 0.2f;
-        float angle = p * M_PI * 2 + t * avel;
+// Queue the scene's objects, splitting the work across threads if there
+// are enough of them. Each chunk gets its own queue, and the queues are
+// appended to the packet's in chunk order, so the result is the same no
+// matter which thread did what.
+void queueScene(FramePacket *packet) {
+    if(g_gpuAnimation) {
+        return; // the vertex shader does it all
+    }
+    TRACE_BEGIN("queueScene");
+    SceneJob job;
+    job.view    = packet->fp.view;
+    job.time    = packet->fp.time;
+    job.tanY    = tanf(FOV_Y * 0.5f);
+    job.tanX    = job.tanY * g_aspect;
+    job.program = packet->program;
+
+    ObjectQueue *queue = &packet->objects;
+    unsigned count     = g_sceneObjects;
+    if(jobsThreadCount() > 1 && count >= PARALLEL_MIN_OBJECTS) {
+        unsigned chunks = jobsThreadCount() * CHUNKS_PER_THREAD;
+        jobsParallelFor(queueSceneChunk, &job, count, chunks);
+
+        MergeJob merge;
+        merge.dest     = queue;
+        unsigned total = queue->draws.count;
+        for(unsigned i = 0; i < chunks; i++) {
+            merge.offsets[i] = total;
+            total += g_objectChunks[i].draws.count;
+        }
+        reserveObjects(queue, total);
+        jobsParallelFor(mergeSceneChunk, &merge, chunks, chunks);
+        queue->draws.count = total;
+    } else {
+        queueSceneObjects(&job, 0, count, queue, g_tfsView);
+    }
+    TRACE_END();
+}
 
-        float x = cosf(angle) * 4.0f;
-        float y = sinf(angle) * 4.0f;
-        float s = 1.0 / sqrtf(2);
+// Draw the objects the logic stage queued.
+void drawScene(FramePacket *packet) {
+    TRACE_BEGIN("drawScene");
+    // If F5 replaced the mesh shader after the objects were queued, they
+    // still refer to the deleted one. They're sorted by it, so all of them
+    // can be pointed at the new one without sorting again.
+    if(packet->program != g_shaderMesh) {
+        RenderItem *items = packet->objects.draws.items;
+        for(unsigned i = 0; i < packet->objects.draws.count; i++) {
+            if(items[i].program == packet->program) {
+                items[i].program = g_shaderMesh;
+            }
+        }
+    }
+    // With --gpu-animation nothing was queued, but this still uploads the
+    // pass's data.
+    flushObjects(packet);
+    if(g_gpuAnimation) {
+        drawOrbits();
+    }
+    TRACE_END();
+}
 
-        tfsPush(g_tfsView);
-        tfsApply(g_tfsView, tfTranslate(x, y, -10));
-        tfsApply(g_tfsView, tfScale(0.5f));
-        tfsApply(g_tfsView, tfRotate(-t * 0.5f, 0, s, s));
+// ---- particles ----
+
+// There are a few fountains that slowly circle around behind the first
+// ring of cubes, sharing the particles between them.
+enum { FOUNTAINS = 4 };
+
+// Get the i'th fountain at a point in time.
+ParticleEmitter getFountain(int i, float time) {
+    ParticleEmitter fountain;
+    memset(&fountain, 0, sizeof(fountain));
+    float angle          = i * M_PI * 2 / FOUNTAINS + time * 0.1f;
+    fountain.position[0] = cosf(angle) * 3.0f;
+    fountain.position[1] = -3.0f;
+    fountain.position[2] = -12.0f + sinf(angle) * 3.0f;
+    fountain.velocity[1] = 5.0f;
+    fountain.spread      = 1.0f;
+    fountain.life        = 3.0f;
+    fountain.count       = g_particles / FOUNTAINS;
+    return fountain;
+}
 
-        objectParams.transform = tfsGet(g_tfsView);
-        queueObject(&objectParams);
+void initParticles() {
+    g_fountains = psCreate(g_particles);
+    psSetGravity(g_fountains, 0, -4.0f, 0);
+    for(int i = 0; i < FOUNTAINS; i++) {
+        ParticleEmitter fountain = getFountain(i, g_time);
+        psAddEmitter(g_fountains, &fountain);
+    }
+}
 
-        tfsPop(g_tfsView);
+// Move the fountains along and let the GPU do the rest.
+void drawParticles(float dt, float time) {
+    if(!g_fountains) {
+        return;
+    }
+    for(int i = 0; i < FOUNTAINS; i++) {
+        ParticleEmitter fountain = getFountain(i, time);
+        psSetEmitter(g_fountains, i, &fountain);
     }
-    flushObjects();
+    psUpdate(g_fountains, dt, time);
+    psDraw(g_fountains, g_renderScale);
+    g_drawCalls += 2; // the transform feedback update and the draw
 }
 
-// ---- object batching ----
+// ---- CPU particles ----
+
+// A spray of sparks sweeps back and forth in front of the fountains and
+// bounces off the floor. It's simulated in g_spray on the CPU, streamed to
+// g_ringSprites every frame and drawn with one instanced draw.
+
+// Sparks live this long on average, so spawning --cpu-particles of them
+// per this many seconds keeps the pool about full.
+const float SPRAY_LIFE = 4.0f;
+
+// Sprays with at least this many particles are updated on all threads.
+enum { PARALLEL_MIN_PARTICLES = 16384 };
+
+float g_sprayDue = 0; // particles to spawn that didn't fit in earlier frames
 
-enum { OBJECT_QUEUE_SIZE   = 64 };
-unsigned char *objectQueue = NULL;
-unsigned objectQueuePos    = 0;
-unsigned objectStride      = 0; // see initBuffers()
+typedef struct SprayJob {
+    ParticleForces forces;
+    float dt;
+    float *instances; // per-particle data, see ppWriteInstances()
+} SprayJob;
 
-unsigned getObjectQueueOffset(int pos) {
-    return objectStride * pos;
+// Update a chunk of particle blocks. Whole blocks never share SIMD lanes,
+// so the chunks can't step on each other.
+void updateSprayChunk(void *data, unsigned first, unsigned count,
+                      unsigned chunk) {
+    SprayJob *job = (SprayJob *)data;
+    (void)chunk;
+    ppUpdateRange(&g_spray, &job->forces, job->dt, first * PP_BLOCK,
+                  count * PP_BLOCK);
 }
 
-unsigned padToAlign(unsigned size, unsigned align) {
-    return size + (align - (size % align)) % align;
+void writeSprayChunk(void *data, unsigned first, unsigned count,
+                     unsigned chunk) {
+    SprayJob *job = (SprayJob *)data;
+    (void)chunk;
+    ppWriteInstances(&g_spray, job->instances + first * 4, first, count);
 }
 
-// Pads sizes to match GL uniform offset alignment requirements.
-unsigned getUniformStride(unsigned size) {
-    return padToAlign(size, g_glUniformAlignment);
+float randomRange(float min, float max) {
+    return min + (max - min) * (rand() / (float)RAND_MAX);
 }
 
-void queueObject(ObjectParams *params) {
-    // TODO: take arguments for texture, mesh, etc. and store them too
-    if(objectQueuePos == OBJECT_QUEUE_SIZE) {
-        flushObjects();
+void spawnSpray(float dt, float time) {
+    float position[3] = {sinf(time * 0.7f) * 2.0f, -2.5f, -8.0f};
+    g_sprayDue += g_cpuParticles / SPRAY_LIFE * dt;
+    for(; g_sprayDue >= 1.0f; g_sprayDue -= 1.0f) {
+        float velocity[3] = {randomRange(-1.5f, 1.5f), randomRange(4.0f, 7.0f),
+                             randomRange(-1.5f, 1.5f)};
+        float life = SPRAY_LIFE * randomRange(0.5f, 1.5f);
+        if(!ppSpawn(&g_spray, position, velocity, life)) {
+            g_sprayDue = 0;
+            break;
+        }
     }
-    unsigned offset    = getObjectQueueOffset(objectQueuePos);
-    ObjectParams *dest = (ObjectParams *)(objectQueue + offset);
-    memcpy(dest, params, sizeof(ObjectParams));
-    objectQueuePos++;
 }
 
-void flushObjects() {
-    if(objectQueuePos == 0) {
+void initSpray() {
+    ppInit(&g_spray, g_cpuParticles);
+    // The particles are a vec4 per instance. They move around the ring,
+    // so the attribute gets pointed at them every frame.
+    g_ringSprites = ringCreate(GL_ARRAY_BUFFER, 1 << 20,
+                               ringGetStats(g_ringUniforms).strategy);
+    g_vaSprites = dsaCreateVertexArray();
+    dsaVertexAttribDivisor(g_vaSprites, 0, 1);
+    printf("simulating %u particles on the CPU with %s\n", g_cpuParticles,
+           ppInstructionSet());
+}
+
+void drawSpray(float dt, float time) {
+    if(!g_ringSprites) {
+        return;
+    }
+    SprayJob job;
+    memset(&job, 0, sizeof(job));
+    job.forces.gravity[1] = -9.8f;
+    job.forces.drag       = 0.3f;
+    job.forces.floorY     = -3.0f;
+    job.forces.bounce     = 0.5f;
+    job.dt                = dt;
+
+    spawnSpray(dt, time);
+    unsigned chunks = jobsThreadCount() * CHUNKS_PER_THREAD;
+    int parallel    = jobsThreadCount() > 1 &&
+                      g_spray.count >= PARALLEL_MIN_PARTICLES;
+    if(parallel) {
+        unsigned blocks = (g_spray.count + PP_BLOCK - 1) / PP_BLOCK;
+        jobsParallelFor(updateSprayChunk, &job, blocks, chunks);
+    } else {
+        ppUpdateRange(&g_spray, &job.forces, dt, 0, g_spray.count);
+    }
+    unsigned count = ppCompact(&g_spray);
+    if(!count) {
         return;
     }
-    glBindVertexArray(g_meshCube.vertexArray);
-    glBindBuffer(GL_UNIFORM_BUFFER, g_ubObjects);
 
-    // FIXME: There are many faster ways to do this, including at least:
-    // - buffer orphaning through glBufferData
-    // - persistent-mapped buffers (GL 4.3+, but available on many GL3 impls)
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, objectStride * objectQueuePos,
-                    objectQueue);
+    unsigned size = sizeof(float) * 4 * count, offset;
+    ringReserve(g_ringSprites, size);
+    job.instances = (float *)ringBeginWrite(g_ringSprites, size, 16, &offset);
+    if(parallel) {
+        jobsParallelFor(writeSprayChunk, &job, count, chunks);
+    } else {
+        ppWriteInstances(&g_spray, job.instances, 0, count);
+    }
+    ringEndWrite(g_ringSprites, size);
+    dsaVertexAttrib(g_vaSprites, 0, ringGetBuffer(g_ringSprites), 4,
+                    GL_FLOAT, sizeof(float) * 4, offset);
+
+    // Blended like the GPU particles, see psDraw().
+    gsUseProgram(g_shaderSprite);
+    gsBindVertexArray(g_vaSprites);
+    gsEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    gsDepthMask(GL_FALSE);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+    gsDepthMask(GL_TRUE);
+    gsDisable(GL_BLEND);
+    g_drawCalls++;
+}
+
+// ---- overlay ----
+
+double g_overlayMillis = 0; // CPU time drawOverlay() took last frame
+
+double millisBetween(Uint64 start, Uint64 end) {
+    return (end - start) * 1000.0 / SDL_GetPerformanceFrequency();
+}
 
-    for(unsigned i = 0; i < objectQueuePos; i++) {
-        unsigned offset = objectStride * i;
-        glBindBufferRange(GL_UNIFORM_BUFFER, 1, g_ubObjects, offset,
-                          objectStride);
-        glDrawArrays(GL_TRIANGLES, 0, g_meshCube.vertices);
+// Draw the numbers from the window title in the top left corner, where
+// they can be seen in fullscreen too.
+void drawOverlay() {
+    Uint64 start = SDL_GetPerformanceCounter();
+    ovBegin(g_windowWidth, g_windowHeight);
+    float graphY = 8; // below the panel if it's there
+    if(g_showOverlay) {
+        GLStateStats gs    = gsGetStats();
+        FrameTimeStats *ft = &g_frameStats;
+        char text[512];
+        int length         = snprintf(
+            text, sizeof(text),
+            "%.1f FPS, %u stutters\np50 %.2f  p95 %.2f ms\n"
+            "p99 %.2f  max %.2f ms\n%u draws, %.1f KiB/frame\n"
+            "%u state calls, %u skipped\noverlay %.3f ms",
+            g_fps, ft->stutters, ft->p50, ft->p95, ft->p99, ft->max,
+            g_drawCalls, g_uploadBytes / 1024.0f, gs.issued, gs.skipped,
+            g_overlayMillis);
+        if(g_gpuBudget > 0) {
+            length += snprintf(text + length, sizeof(text) - length,
+                               "\nrender scale %.0f%%", 100 * g_renderScale);
+        }
+        // GPU times are averaged, they're too jumpy to read otherwise
+        for(int i = 0; i < gtScopeCount(); i++) {
+            float millis = gtAverageMillis(i);
+            if(millis >= 0) {
+                length += snprintf(text + length, sizeof(text) - length,
+                                   "\nGPU %-9s %6.2f ms", gtScopeName(i),
+                                   millis);
+            }
+        }
+        // a translucent panel behind the text at scale 2, as wide as its
+        // longest line
+        int lines = 1, columns = 0, longest = 0;
+        for(const char *c = text; *c; c++) {
+            if(*c == '\n') {
+                lines++;
+                columns = 0;
+            } else if(++columns > longest) {
+                longest = columns;
+            }
+        }
+        float width  = longest * OV_GLYPH_WIDTH * 2 + 8;
+        float height = lines * OV_GLYPH_HEIGHT * 2 + 6;
+        ovRect(4, 4, width, height, 0x000000a0);
+        graphY = height + 12;
+        ovText(8, 8, 2, 0xffffffff, text);
     }
-    objectQueuePos = 0;
+    if(g_showGraph) {
+        // two frames at 60 Hz tall, with the budget labels on the right
+        pgDraw(8, graphY, PG_HISTORY * 2, 160, 33.3f);
+    }
+    if(ovFlush()) {
+        g_drawCalls++;
+    }
+    g_overlayMillis = millisBetween(start, SDL_GetPerformanceCounter());
+}
+
+// ---- frame timing ----
+
+// graph series, see perfgraph.c
+int g_graphFrame, g_graphCPU, g_graphGPU, g_graphScene, g_graphPost;
+int g_graphGPUScene, g_graphGPUParticles, g_graphGPUPost;
+
+void initFrameTiming() {
+    g_timerFrame     = gtScope("frame");
+    g_timerScene     = gtScope("scene");
+    g_timerParticles = gtScope("particles");
+    g_timerPost      = gtScope("post");
+
+    g_graphFrame        = pgAddSeries("frame", 0xffffffff);
+    g_graphCPU          = pgAddSeries("CPU", 0xffd040ff);
+    g_graphGPU          = pgAddSeries("GPU", 0x40ff60ff);
+    g_graphScene        = pgAddSeries("CPU scene", 0x40c0ffff);
+    g_graphPost         = pgAddSeries("CPU post", 0xff60ffff);
+    g_graphGPUScene     = pgAddSeries("GPU scene", 0x4060ffff);
+    g_graphGPUParticles = pgAddSeries("GPU particles", 0xff8040ff);
+    g_graphGPUPost      = pgAddSeries("GPU post", 0xc040ffff);
+}
+
+// Record the frame's timings in the graph. GPU times arrive a few frames
+// late, so they're graphed a little to the right of where they belong.
+// CPU times include the logic stage's, even when --pipeline overlaps it
+// with rendering the previous frame.
+void endFrameTiming(FramePacket *packet, Uint64 frameStart,
+                    Uint64 sceneEnd) {
+    Uint64 now = SDL_GetPerformanceCounter();
+    gtEnd(g_timerFrame);
+    if(gtEndFrame()) {
+        if(drAddFrame(&g_dynres, gtLastMillis(g_timerFrame))) {
+            g_renderScale = g_dynres.scale;
+        }
+        pgSample(g_graphGPU, gtLastMillis(g_timerFrame));
+        pgSample(g_graphGPUScene, gtLastMillis(g_timerScene));
+        pgSample(g_graphGPUParticles, gtLastMillis(g_timerParticles));
+        pgSample(g_graphGPUPost, gtLastMillis(g_timerPost));
+    }
+    double logic = packet->logicMillis;
+    pgSample(g_graphFrame, packet->dt * 1000);
+    pgSample(g_graphCPU, logic + millisBetween(frameStart, now));
+    pgSample(g_graphScene, logic + millisBetween(frameStart, sceneEnd));
+    pgSample(g_graphPost, millisBetween(sceneEnd, now));
+    pgEndFrame();
+}
+
+// ---- object batching ----
+
+// Objects are collected for the whole frame (or pass) and drawn with one
+// flushObjects() call once all of them are known. The draws go into the
+// frame packet's objects.draws, which is sorted by state, and their
+// parameters into objects.params. Both grow geometrically as needed, so
+// after the first few frames they're big enough to never be reallocated
+// again. The logic stage queues and sorts, the render stage uploads and
+// draws.
+// The parameters are uploaded in sorted order, so the instances of a mesh
+// always have consecutive transforms no matter how they were queued.
+// Every drawing method reads them through g_texObjects, starting from the
+// pass's FrameParams.firstObject, so no matter how many objects there are
+// they're bound once per pass.
+
+// Make room for the parameters of as many objects as queue->draws holds.
+void growObjectQueue(ObjectQueue *queue, unsigned capacity) {
+    queue->params = (ObjectParams *)realloc(queue->params,
+                                            sizeof(ObjectParams) * capacity);
+    // The queue only grows when a frame has more objects than any before,
+    // so this doubles as a log of the high water mark.
+    if(queue->logGrowth && queue->capacity) {
+        printf("object queue grown to %u objects\n", capacity);
+    }
+    queue->capacity = capacity;
+}
+
+// Make sure a queue has space for count objects.
+void reserveObjects(ObjectQueue *queue, unsigned count) {
+    unsigned capacity = queue->capacity ? queue->capacity : OBJECT_QUEUE_SIZE;
+    while(capacity < count) {
+        capacity *= 2;
+    }
+    rqReserve(&queue->draws, capacity);
+    if(capacity > queue->capacity) {
+        growObjectQueue(queue, capacity);
+    }
+}
+
+void queueObjectIn(ObjectQueue *queue, ObjectParams *params,
+                   RenderMesh *mesh, GLuint program, GLuint texture) {
+    unsigned pos     = queue->draws.count;
+    RenderItem *item = rqPush(&queue->draws);
+    if(queue->draws.capacity > queue->capacity) {
+        growObjectQueue(queue, queue->draws.capacity);
+    }
+    memcpy(&queue->params[pos], params, sizeof(ObjectParams));
+
+    // Draw front to back within each state to save on shading.
+    float depth       = -params->transform.m[14] / Z_FAR;
+    item->key         = rqMakeKey(program, mesh->vertexArray, texture,
+                                  mesh->id, depth);
+    item->program     = program;
+    item->vertexArray = mesh->vertexArray;
+    item->texture     = texture;
+    item->mesh        = mesh->id;
+    item->firstIndex  = mesh->firstIndex;
+    item->indices     = mesh->indices;
+    item->baseVertex  = mesh->baseVertex;
+    item->transform   = pos;
+}
+
+void queueObject(ObjectParams *params, RenderMesh *mesh, GLuint program,
+                 GLuint texture) {
+    queueObjectIn(g_queue, params, mesh, program, texture);
+}
+
+// Set the state for drawing an item. The state layer skips whatever the
+// previous draw already set.
+void setDrawState(RenderItem *item) {
+    gsUseProgram(item->program);
+    gsBindVertexArray(item->vertexArray);
+    gsBindTexture(0, GL_TEXTURE_2D, item->texture);
+}
+
+// Find the last item that can be drawn as an instance of the same draw as
+// items[first]: same state and mesh, consecutive transforms.
+unsigned findInstanceRun(RenderItem *items, unsigned first, unsigned count) {
+    unsigned last = first;
+    while(last + 1 < count && rqSameMesh(&items[first], &items[last + 1]) &&
+          items[last + 1].transform == items[last].transform + 1) {
+        last++;
+    }
+    return last;
+}
+
+// Draw each run of instances with glDrawElementsInstancedBaseVertex.
+void submitInstanced(RenderItem *items, unsigned count) {
+    for(unsigned i = 0; i < count; i++) {
+        RenderItem *item = &items[i];
+        unsigned last    = findInstanceRun(items, i, count);
+        setDrawState(item);
+        glUniform1i(g_locBaseInstance, item->transform);
+        glDrawElementsInstancedBaseVertex(
+            GL_TRIANGLES, item->indices, GL_UNSIGNED_INT,
+            (void *)(sizeof(GLuint) * item->firstIndex), last - i + 1,
+            item->baseVertex);
+        g_drawCalls++;
+        i = last;
+    }
+}
+
+// Write a draw command for each run of instances and draw everything that
+// shares state with one glMultiDrawElementsIndirect. The commands' base
+// instance picks the transforms, so the baseInstance uniform is left at 0.
+void submitMultiDraw(RenderItem *items, unsigned count) {
+    unsigned numCommands = 0, offset = 0;
+
+    ringReserve(g_ringCommands, sizeof(DrawElementsCommand) * count);
+    DrawElementsCommand *commands = (DrawElementsCommand *)ringBeginWrite(
+        g_ringCommands, sizeof(DrawElementsCommand) * count, sizeof(GLuint),
+        &offset);
+    for(unsigned i = 0; i < count; i++) {
+        RenderItem *item = &items[i];
+        unsigned last    = findInstanceRun(items, i, count);
+        // The mapping may be write-combined memory, so fill in the whole
+        // command at once and never read it back.
+        DrawElementsCommand cmd = {item->indices, last - i + 1,
+                                   item->firstIndex, item->baseVertex,
+                                   item->transform};
+        commands[numCommands++] = cmd;
+        i                       = last;
+    }
+    ringEndWrite(g_ringCommands, sizeof(DrawElementsCommand) * numCommands);
+
+    // Walk the same runs again, one group of commands at a time.
+    gsBindBuffer(GL_DRAW_INDIRECT_BUFFER, ringGetBuffer(g_ringCommands));
+    unsigned command = 0;
+    for(unsigned i = 0; i < count;) {
+        unsigned first = i, firstCommand = command;
+        do {
+            i = findInstanceRun(items, i, count) + 1;
+            command++;
+        } while(i < count && rqSameState(&items[first], &items[i]));
+
+        setDrawState(&items[first]);
+        glUniform1i(g_locBaseInstance, 0);
+        glMultiDrawElementsIndirect(
+            GL_TRIANGLES, GL_UNSIGNED_INT,
+            (void *)(offset + sizeof(DrawElementsCommand) * firstCommand),
+            command - firstCommand, 0);
+        g_drawCalls++;
+    }
+}
+
+// Draw each item separately, pointing baseInstance at its transform.
+void submitSeparate(RenderItem *items, unsigned count) {
+    for(unsigned i = 0; i < count; i++) {
+        RenderItem *item = &items[i];
+        setDrawState(item);
+        glUniform1i(g_locBaseInstance, item->transform);
+        glDrawElementsBaseVertex(GL_TRIANGLES, item->indices,
+                                 GL_UNSIGNED_INT,
+                                 (void *)(sizeof(GLuint) * item->firstIndex),
+                                 item->baseVertex);
+        g_drawCalls++;
+    }
+}
+
+// Point g_texObjects at the uniform ring's buffer, which is replaced when
+// the ring grows.
+void bindObjectTexture() {
+    GLuint buffer = ringGetBuffer(g_ringUniforms);
+    if(buffer != g_texObjectsRing) {
+        if(g_texObjects) {
+            gsDeleteTextures(1, &g_texObjects);
+        }
+        g_texObjects     = dsaCreateTextureBuffer(GL_RGBA32F, buffer);
+        g_texObjectsRing = buffer;
+    }
+    gsBindTexture(1, GL_TEXTURE_BUFFER, g_texObjects);
+}
+
+// The objects are read as texels, so they have to start at one.
+unsigned passAlignment() {
+    return g_glUniformAlignment > 16 ? (unsigned)g_glUniformAlignment : 16;
+}
+
+// Upload the pass's parameters and the parameters of count sorted items of
+// the queue with one write to g_ringUniforms, and bind the pass's
+// parameters to slot #0 and its objects to texture unit 1. Each item is
+// pointed at its transform's index within the upload.
+void uploadPass(FrameParams *fp, ObjectQueue *queue, RenderItem *items,
+                unsigned count) {
+    unsigned align = passAlignment();
+    unsigned size  = upBlockSize(sizeof(FrameParams), align) +
+                    upBlockSize(sizeof(ObjectParams) * count, align);
+    UniformPacker up;
+    upBegin(&up, g_ringUniforms, size, align);
+
+    unsigned offset = 0, objectsOffset = 0;
+    void *frameBlock      = upBlock(&up, sizeof(FrameParams), &offset);
+    ObjectParams *objects = (ObjectParams *)upBlock(
+        &up, sizeof(ObjectParams) * count, &objectsOffset);
+    for(unsigned i = 0; i < count; i++) {
+        memcpy(&objects[i], &queue->params[items[i].transform],
+               sizeof(ObjectParams));
+        items[i].transform = i;
+    }
+    fp->firstObject = (int)(objectsOffset / 16);
+    memcpy(frameBlock, fp, sizeof(FrameParams));
+    upEnd(&up);
+
+    // The block's size in std140 is rounded up to a multiple of vec4, so
+    // bind the aligned slot it lives in rather than just sizeof.
+    gsBindBufferRange(GL_UNIFORM_BUFFER, 0, ringGetBuffer(g_ringUniforms),
+                      offset, upBlockSize(sizeof(FrameParams), align));
+    bindObjectTexture();
+    // Instance numbers have to reach the last object of the pass.
+    mbReserveInstances(&g_meshBuffer, count);
+}
+
+// Sort everything that was queued. This is the logic stage's part of
+// drawing, so it must not touch GL.
+void sortObjects(ObjectQueue *queue) {
+    unsigned count      = queue->draws.count;
+    RenderItem *scratch = (RenderItem *)arenaAlloc(
+        &g_frameArena, sizeof(RenderItem) * count, sizeof(uint64_t));
+    rqSort(&queue->draws, scratch);
+}
+
+// Upload and draw everything in a packet's sorted queue, along with the
+// parameters of the pass.
+void flushObjects(FramePacket *packet) {
+    TRACE_BEGIN("flushObjects");
+    ObjectQueue *queue = &packet->objects;
+    RenderItem *items  = queue->draws.items;
+    unsigned count     = queue->draws.count;
+
+    // Usually the whole pass is one part. Even an empty one is uploaded,
+    // the other passes draw with its FrameParams.
+    unsigned first = 0;
+    do {
+        unsigned part = count - first;
+        if(part > g_maxPassObjects) {
+            part = g_maxPassObjects;
+        }
+        uploadPass(&packet->fp, queue, items + first, part);
+        if(g_instancing) {
+            if(g_multiDraw) {
+                submitMultiDraw(items + first, part);
+            } else {
+                submitInstanced(items + first, part);
+            }
+        } else {
+            submitSeparate(items + first, part);
+        }
+        first += part;
+    } while(first < count);
+    queue->draws.count = 0;
+    TRACE_END();
 }
 
 // ---- random utilities and initialization ----
 
 void drawQuad() {
-    glBindVertexArray(g_vaQuad);
+    gsBindVertexArray(g_vaQuad);
     glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
-}
-
-void updateShaderGlobals(FrameParams *fp) {
-    glBindBuffer(GL_UNIFORM_BUFFER, g_ubGlobals);
-    // Write the struct into target buffer.
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameParams), fp);
-    // Bind uniform buffer slot #0 to g_ubGlobals from offset 0, length
-    // sizeof(FrameParams).
-    // Note that the offset has to be a multiple of
-    // GL_UNIFORM_OFFSET_ALIGNMENT.
-    glBindBufferRange(GL_UNIFORM_BUFFER, 0, g_ubGlobals, 0,
-                      sizeof(FrameParams));
+    g_drawCalls++;
 }
 
 void initBuffers() {
-    // Make a buffer for shader uniform parameters.
-    // Get id for the new buffer.
-    glGenBuffers(1, &g_ubGlobals);
-    // Select the new buffer as our current GL_UNIFORM_BUFFER.
-    // Technically we could bind it in any buffer slot for now, but GL
+    // Make buffers for shader uniform parameters.
+    // These are rewritten every frame, so they're ring buffers that keep
+    // the data of the last few frames around while the GPU is using it.
+    // Technically we could create them in any buffer slot, but GL
     // implementations are allowed to optimize based on where the buffer was
     // bound first. It's probably a good idea to initialize buffers in the slot
     // they will be used in.
-    glBindBuffer(GL_UNIFORM_BUFFER, g_ubGlobals);
-    // GL_DYNAMIC_DRAW hints the buffer is for drawing with frequent updates.
-    // See: https://www.opengl.org/sdk/docs/man/html/glBufferData.xhtml .
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameParams), NULL,
-                 GL_DYNAMIC_DRAW);
-
-    glGenBuffers(1, &g_ubObjects);
-    objectStride = getUniformStride(sizeof(ObjectParams));
-    objectQueue = (unsigned char *)malloc(objectStride * OBJECT_QUEUE_SIZE);
-    glBindBuffer(GL_UNIFORM_BUFFER, g_ubObjects);
-    glBufferData(GL_UNIFORM_BUFFER, objectStride * OBJECT_QUEUE_SIZE, NULL,
-                 GL_DYNAMIC_DRAW);
+    // Multi-draws need per-draw base instances to find their transforms.
+    if(g_multiDraw &&
+       !(GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance)) {
+        g_multiDraw = 0;
+    }
+    printf("drawing objects with %s\n",
+           !g_instancing ? "separate draws"
+                         : g_multiDraw ? "multi-draw indirect"
+                                       : "instanced draws");
+    // Which upload strategy is fastest depends on the driver, so unless
+    // one was requested, try a few frames of instance batches with each.
+    UploadStrategy strategy = (UploadStrategy)g_uploadStrategy;
+    if(strategy == UPLOAD_AUTO) {
+        unsigned batchBytes = sizeof(ObjectParams) * OBJECT_QUEUE_SIZE;
+        strategy = ringCalibrate(GL_UNIFORM_BUFFER, batchBytes * 64,
+                                 batchBytes, 16, g_glUniformAlignment);
+        g_uploadStrategy = strategy; // so benchmark reports name it
+    }
+    // The ring only grows until an upload fits in half of it, so keeping
+    // uploads within a quarter of the texture's reach keeps the ring
+    // within all of it.
+    GLint maxTexels = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+    unsigned ringLimit = maxTexels < (1 << 26) ? (unsigned)maxTexels * 16
+                                               : 1u << 30;
+    unsigned ringSize  = UNIFORM_RING_SIZE < ringLimit ? UNIFORM_RING_SIZE
+                                                       : ringLimit;
+    // FrameParams and the objects are each padded to the alignment
+    unsigned objectBytes =
+        ringLimit / 4 - sizeof(FrameParams) - 2 * passAlignment();
+    g_maxPassObjects = objectBytes / sizeof(ObjectParams);
+    g_ringUniforms   = ringCreate(GL_UNIFORM_BUFFER, ringSize, strategy);
+    // Without indirect draws, GL_DRAW_INDIRECT_BUFFER isn't a valid target.
+    if(g_multiDraw) {
+        g_ringCommands =
+            ringCreate(GL_DRAW_INDIRECT_BUFFER, 1 << 20, strategy);
+    }
+    for(int i = 0; i < FRAME_PACKETS; i++) {
+        g_packets[i].objects.logGrowth = 1;
+        g_packets[i].program           = g_shaderMesh;
+        reserveObjects(&g_packets[i].objects, OBJECT_QUEUE_SIZE);
+    }
 
     // This can be used as a GL_TRIANGLE_FAN of vec2s to draw a rectangle.
     float quadVertices[] = {
         1.0f, 1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, -1.0f,
     };
-    glGenBuffers(1, &g_bufQuad);
-    glBindBuffer(GL_ARRAY_BUFFER, g_bufQuad);
+    g_bufQuad = dsaCreateBuffer(GL_ARRAY_BUFFER);
     // Allocate and fill the buffer with data.
     // GL_STATIC_DRAW hints this is static (e.g. mesh) data for drawing.
-    glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices,
-                 GL_STATIC_DRAW);
+    dsaBufferData(g_bufQuad, sizeof(quadVertices), quadVertices,
+                  GL_STATIC_DRAW);
 
     // Vertex Array Objects store vertex input state.
-    // When we enable vertex arrays and assign pointers, the calls modify
-    // the currently bound Vertex Array.
     // NOTE: The GL_ELEMENT_ARRAY_BUFFER binding is part of the VAO's state.
-    // If you need to bind those somewhere else (e.g. to generate them),
-    // make a scratchpad VAO just for that or you may experience pain.
-    glGenVertexArrays(1, &g_vaQuad);
-    glBindVertexArray(g_vaQuad);
-    glEnableVertexAttribArray(0); // enable the VAO's attrib #0
-    // Set vertex attribute #0 to read 2x float (vec2) from the currently
-    // bound ARRAY_BUFFER, with no normalization, 0 stride (= tight packing)
-    // starting from offset 0 in the buffer.
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, 0);
+    // Without DSA, binding one to fill it modifies the bound VAO, which is
+    // why dsa.c never does that.
+    g_vaQuad = dsaCreateVertexArray();
+    // Set vertex attribute #0 to read 2x float (vec2) from the buffer, with
+    // no normalization, packed tightly and starting from offset 0.
+    dsaVertexAttrib(g_vaQuad, 0, g_bufQuad, 2, GL_FLOAT, sizeof(float) * 2,
+                    0);
 }
 
 void initRenderTargets() {
-    // since we allowed window resizing, we want this to work multiple times
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    if(!g_texOffscreen) {
-        glGenTextures(1, &g_texOffscreen);
-    }
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, g_texOffscreen);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, g_windowWidth, g_windowHeight, 0,
-                 GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-
-    if(g_fbOffscreen) {
-        glDeleteFramebuffers(1, &g_fbOffscreen);
-    }
-    glGenFramebuffers(1, &g_fbOffscreen);
-    glBindFramebuffer(GL_FRAMEBUFFER, g_fbOffscreen);
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
-                           g_texOffscreen, 0);
-
-    if(!g_rbOffscreen) {
-        glGenRenderbuffers(1, &g_rbOffscreen);
-    }
-    glBindRenderbuffer(GL_RENDERBUFFER, g_rbOffscreen);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, g_windowWidth,
-                          g_windowHeight);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
-                              GL_RENDERBUFFER, g_rbOffscreen);
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // Targets are created by renderDemo() as it needs them, and resizing
+    // the window only changes which size it asks for.
+    rtInit();
+    g_targetWidth  = g_windowWidth;
+    g_targetHeight = g_windowHeight;
 }
 
 RenderMesh loadMeshToArray(const char *filename) {
@@ -341,33 +1287,9 @@ RenderMesh loadMeshToArray(const char *filename) {
     if(!meshObj) { // obj load failed
         return renderMesh;
     }
-    renderMesh.vertices = meshGetNumVertices(meshObj);
-    unsigned stride     = sizeof(float) * (3 + 2 + 3);
-
-    glGenBuffers(1, &renderMesh.buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, renderMesh.buffer);
-    glBufferData(GL_ARRAY_BUFFER, renderMesh.vertices * stride, NULL,
-                 GL_STATIC_DRAW);
-
-    void *ptr = glMapBuffer(GL_ARRAY_BUFFER, GL_WRITE_ONLY);
-    meshPackVertices(meshObj, (float *)ptr);
-    glUnmapBuffer(GL_ARRAY_BUFFER);
-
-    glGenVertexArrays(1, &renderMesh.vertexArray);
-    glBindVertexArray(renderMesh.vertexArray);
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-    glEnableVertexAttribArray(2);
-    // Bind vertex inputs for vertex positions, texture coords and normals.
-    // The offsets (last argument) are set relative to the ARRAY_BUFFER
-    // bound when glVertexAttribPointer is called.
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride,
-                          (void *)(sizeof(float) * 3));
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride,
-                          (void *)(sizeof(float) * (3 + 2)));
-
-    glBindVertexArray(0);
+    // All meshes share one set of buffers and a vertex array.
+    renderMesh = mbAddMesh(&g_meshBuffer, meshObj);
+    meshClose(meshObj);
     return renderMesh;
 }
 
@@ -379,6 +1301,20 @@ void loadMesh(RenderMesh *dest, const char *filename) {
 void loadTexture(GLuint *dest, const char *filename) {
     *dest = loadImageToTexture(filename);
 }
+void meshShaderCompiled(ShaderSourceSpec *spec) {
+    g_locBaseInstance = glGetUniformLocation(*spec->idPtr, "baseInstance");
+    // The color texture is on unit 0, objects go on unit 1.
+    gsUseProgram(*spec->idPtr);
+    glUniform1i(glGetUniformLocation(*spec->idPtr, "objects"), 1);
+}
+void postFXShaderCompiled(ShaderSourceSpec *spec) {
+    g_locUVScale = glGetUniformLocation(*spec->idPtr, "uvScale");
+}
+void orbitShaderCompiled(ShaderSourceSpec *spec) {
+    // The color texture is on unit 0, orbits go on unit 1.
+    gsUseProgram(*spec->idPtr);
+    glUniform1i(glGetUniformLocation(*spec->idPtr, "orbits"), 1);
+}
 
 // ---- potentially buggy linear algebra follows ----
 
@@ -0,0 +1,352 @@
+/**
+ * dsa.c
+ * Object creation and editing with or without direct state access.
+ *
+ * The fallback edits buffers through GL_COPY_WRITE_BUFFER (and reads them
+ * through GL_COPY_READ_BUFFER), which nothing draws from, and textures
+ * through unit 0. It goes through the state layer so its shadow copy of
+ * the bindings stays right.
+ */
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <assert.h>
+#include <stdio.h>
+#include "dsa.h"
+#include "glstate.h"
+
+static int useDSA = 0;
+
+void dsaInit(int allowed) {
+    useDSA = allowed && (GLEW_VERSION_4_5 || GLEW_ARB_direct_state_access);
+    printf("editing GL objects with %s\n",
+           useDSA ? "direct state access" : "bind-to-edit");
+}
+
+int dsaEnabled() {
+    return useDSA;
+}
+
+// ---- buffers ----
+
+GLuint dsaCreateBuffer(GLenum target) {
+    GLuint buffer = 0;
+    if(useDSA) {
+        glCreateBuffers(1, &buffer);
+        return buffer;
+    }
+    // Binding to GL_ELEMENT_ARRAY_BUFFER would change the bound VAO.
+    if(target == GL_ELEMENT_ARRAY_BUFFER) {
+        target = GL_COPY_WRITE_BUFFER;
+    }
+    glGenBuffers(1, &buffer);
+    gsBindBuffer(target, buffer); // this actually creates the buffer
+    return buffer;
+}
+
+void dsaBufferData(GLuint buffer, GLsizeiptr size, const void *data,
+                   GLenum usage) {
+    if(useDSA) {
+        glNamedBufferData(buffer, size, data, usage);
+    } else {
+        gsBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, size, data, usage);
+    }
+}
+
+void dsaBufferStorage(GLuint buffer, GLsizeiptr size, const void *data,
+                      GLbitfield flags) {
+    if(useDSA) {
+        glNamedBufferStorage(buffer, size, data, flags);
+    } else {
+        gsBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferStorage(GL_COPY_WRITE_BUFFER, size, data, flags);
+    }
+}
+
+void dsaBufferSubData(GLuint buffer, GLintptr offset, GLsizeiptr size,
+                      const void *data) {
+    if(useDSA) {
+        glNamedBufferSubData(buffer, offset, size, data);
+    } else {
+        gsBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+    }
+}
+
+void dsaCopyBufferSubData(GLuint readBuffer, GLuint writeBuffer,
+                          GLintptr readOffset, GLintptr writeOffset,
+                          GLsizeiptr size) {
+    if(useDSA) {
+        glCopyNamedBufferSubData(readBuffer, writeBuffer, readOffset,
+                                 writeOffset, size);
+    } else {
+        gsBindBuffer(GL_COPY_READ_BUFFER, readBuffer);
+        gsBindBuffer(GL_COPY_WRITE_BUFFER, writeBuffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER,
+                            readOffset, writeOffset, size);
+    }
+}
+
+void *dsaMapBufferRange(GLuint buffer, GLintptr offset, GLsizeiptr length,
+                        GLbitfield access) {
+    if(useDSA) {
+        return glMapNamedBufferRange(buffer, offset, length, access);
+    }
+    gsBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+    return glMapBufferRange(GL_COPY_WRITE_BUFFER, offset, length, access);
+}
+
+void dsaUnmapBuffer(GLuint buffer) {
+    if(useDSA) {
+        glUnmapNamedBuffer(buffer);
+    } else {
+        // The mapping belongs to the buffer, not the binding it was made
+        // through, so any target will do.
+        gsBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    }
+}
+
+// ---- textures ----
+
+GLuint dsaCreateTexture2D() {
+    GLuint texture = 0;
+    if(useDSA) {
+        glCreateTextures(GL_TEXTURE_2D, 1, &texture);
+        return texture;
+    }
+    glGenTextures(1, &texture);
+    gsBindTexture(0, GL_TEXTURE_2D, texture);
+    return texture;
+}
+
+// Get a pixel format and type glTexImage2D accepts for a sized internal
+// format. No data is passed, so they only have to be valid.
+static void getTransferFormat(GLenum internalFormat, GLenum *format,
+                              GLenum *type) {
+    switch(internalFormat) {
+    case GL_DEPTH_COMPONENT16:
+    case GL_DEPTH_COMPONENT24:
+    case GL_DEPTH_COMPONENT32F:
+        *format = GL_DEPTH_COMPONENT;
+        *type   = GL_FLOAT;
+        break;
+    case GL_R8:
+        *format = GL_RED;
+        *type   = GL_UNSIGNED_BYTE;
+        break;
+    case GL_RGB8:
+        *format = GL_RGB;
+        *type   = GL_UNSIGNED_BYTE;
+        break;
+    default:
+        *format = GL_RGBA;
+        *type   = GL_UNSIGNED_BYTE;
+        break;
+    }
+}
+
+void dsaTextureStorage2D(GLuint texture, GLsizei levels,
+                         GLenum internalFormat, GLsizei width,
+                         GLsizei height) {
+    if(useDSA) {
+        glTextureStorage2D(texture, levels, internalFormat, width, height);
+        return;
+    }
+    gsBindTexture(0, GL_TEXTURE_2D, texture);
+    if(GLEW_ARB_texture_storage) {
+        glTexStorage2D(GL_TEXTURE_2D, levels, internalFormat, width, height);
+        return;
+    }
+    // Specify each level by hand, and limit the texture to them so it's
+    // complete in the same way immutable storage would be.
+    GLenum format, type;
+    getTransferFormat(internalFormat, &format, &type);
+    for(GLsizei level = 0; level < levels; level++) {
+        glTexImage2D(GL_TEXTURE_2D, level, internalFormat, width, height, 0,
+                     format, type, NULL);
+        width  = width > 1 ? width / 2 : 1;
+        height = height > 1 ? height / 2 : 1;
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+}
+
+void dsaTextureSubImage2D(GLuint texture, GLint level, GLint x, GLint y,
+                          GLsizei width, GLsizei height, GLenum format,
+                          GLenum type, const void *pixels) {
+    if(useDSA) {
+        glTextureSubImage2D(texture, level, x, y, width, height, format,
+                            type, pixels);
+    } else {
+        gsBindTexture(0, GL_TEXTURE_2D, texture);
+        glTexSubImage2D(GL_TEXTURE_2D, level, x, y, width, height, format,
+                        type, pixels);
+    }
+}
+
+void dsaTextureParameteri(GLuint texture, GLenum name, GLint value) {
+    if(useDSA) {
+        glTextureParameteri(texture, name, value);
+    } else {
+        gsBindTexture(0, GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, name, value);
+    }
+}
+
+GLuint dsaCreateTextureBuffer(GLenum internalFormat, GLuint buffer) {
+    GLuint texture = 0;
+    if(useDSA) {
+        glCreateTextures(GL_TEXTURE_BUFFER, 1, &texture);
+        glTextureBuffer(texture, internalFormat, buffer);
+    } else {
+        glGenTextures(1, &texture);
+        gsBindTexture(0, GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, internalFormat, buffer);
+    }
+    return texture;
+}
+
+// ---- renderbuffers and framebuffers ----
+
+GLuint dsaCreateRenderbuffer() {
+    GLuint renderbuffer = 0;
+    if(useDSA) {
+        glCreateRenderbuffers(1, &renderbuffer);
+        return renderbuffer;
+    }
+    // Nothing else uses the renderbuffer binding, so it's not tracked.
+    glGenRenderbuffers(1, &renderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+    return renderbuffer;
+}
+
+void dsaRenderbufferStorage(GLuint renderbuffer, GLenum internalFormat,
+                            GLsizei width, GLsizei height) {
+    if(useDSA) {
+        glNamedRenderbufferStorage(renderbuffer, internalFormat, width,
+                                   height);
+    } else {
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, internalFormat, width,
+                              height);
+    }
+}
+
+GLuint dsaCreateFramebuffer() {
+    GLuint framebuffer = 0;
+    if(useDSA) {
+        glCreateFramebuffers(1, &framebuffer);
+        return framebuffer;
+    }
+    glGenFramebuffers(1, &framebuffer);
+    gsBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    return framebuffer;
+}
+
+void dsaFramebufferTexture(GLuint framebuffer, GLenum attachment,
+                           GLuint texture, GLint level) {
+    if(useDSA) {
+        glNamedFramebufferTexture(framebuffer, attachment, texture, level);
+    } else {
+        gsBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D,
+                               texture, level);
+    }
+}
+
+void dsaFramebufferRenderbuffer(GLuint framebuffer, GLenum attachment,
+                                GLuint renderbuffer) {
+    if(useDSA) {
+        glNamedFramebufferRenderbuffer(framebuffer, attachment,
+                                       GL_RENDERBUFFER, renderbuffer);
+    } else {
+        gsBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, attachment,
+                                  GL_RENDERBUFFER, renderbuffer);
+    }
+}
+
+GLenum dsaCheckFramebufferStatus(GLuint framebuffer) {
+    if(useDSA) {
+        return glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER);
+    }
+    gsBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    return glCheckFramebufferStatus(GL_FRAMEBUFFER);
+}
+
+// ---- vertex arrays ----
+
+GLuint dsaCreateVertexArray() {
+    GLuint vertexArray = 0;
+    if(useDSA) {
+        glCreateVertexArrays(1, &vertexArray);
+        return vertexArray;
+    }
+    glGenVertexArrays(1, &vertexArray);
+    gsBindVertexArray(vertexArray);
+    return vertexArray;
+}
+
+// Set up one attribute; the last argument says if it's an integer one.
+static void setAttrib(GLuint vertexArray, GLuint index, GLuint buffer,
+                      GLint size, GLenum type, GLsizei stride,
+                      GLintptr offset, int integer) {
+    assert(stride > 0);
+    if(useDSA) {
+        glVertexArrayVertexBuffer(vertexArray, index, buffer, offset,
+                                  stride);
+        if(integer) {
+            glVertexArrayAttribIFormat(vertexArray, index, size, type, 0);
+        } else {
+            glVertexArrayAttribFormat(vertexArray, index, size, type,
+                                      GL_FALSE, 0);
+        }
+        glVertexArrayAttribBinding(vertexArray, index, index);
+        glEnableVertexArrayAttrib(vertexArray, index);
+        return;
+    }
+    // The offset is taken relative to the GL_ARRAY_BUFFER bound when the
+    // pointer is set.
+    gsBindVertexArray(vertexArray);
+    gsBindBuffer(GL_ARRAY_BUFFER, buffer);
+    if(integer) {
+        glVertexAttribIPointer(index, size, type, stride, (void *)offset);
+    } else {
+        glVertexAttribPointer(index, size, type, GL_FALSE, stride,
+                              (void *)offset);
+    }
+    glEnableVertexAttribArray(index);
+}
+
+void dsaVertexAttrib(GLuint vertexArray, GLuint index, GLuint buffer,
+                     GLint size, GLenum type, GLsizei stride,
+                     GLintptr offset) {
+    setAttrib(vertexArray, index, buffer, size, type, stride, offset, 0);
+}
+
+void dsaVertexAttribI(GLuint vertexArray, GLuint index, GLuint buffer,
+                      GLint size, GLenum type, GLsizei stride,
+                      GLintptr offset) {
+    setAttrib(vertexArray, index, buffer, size, type, stride, offset, 1);
+}
+
+void dsaVertexAttribDivisor(GLuint vertexArray, GLuint index,
+                            GLuint divisor) {
+    if(useDSA) {
+        glVertexArrayBindingDivisor(vertexArray, index, divisor);
+    } else {
+        gsBindVertexArray(vertexArray);
+        glVertexAttribDivisor(index, divisor);
+    }
+}
+
+void dsaVertexArrayElementBuffer(GLuint vertexArray, GLuint buffer) {
+    if(useDSA) {
+        glVertexArrayElementBuffer(vertexArray, buffer);
+    } else {
+        // This one is part of the VAO's state.
+        gsBindVertexArray(vertexArray);
+        gsBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+    }
+}
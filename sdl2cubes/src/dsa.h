@@ -0,0 +1,70 @@
+#ifndef CUBES_DSA_H
+#define CUBES_DSA_H
+
+// Creating and editing GL objects without binding them first. With GL 4.5
+// or ARB_direct_state_access the objects are edited by name, so bindings
+// the renderer made stay as they are. Otherwise these fall back to binding
+// the object through the state layer and editing the binding, and leave it
+// bound. Either way, don't count on any bindings after calling them.
+
+// pick DSA if it's allowed and available
+void dsaInit(int allowed);
+// check if the DSA entry points are used
+int dsaEnabled();
+
+// create a buffer; the fallback creates it in the target it'll be used in
+GLuint dsaCreateBuffer(GLenum target);
+void dsaBufferData(GLuint buffer, GLsizeiptr size, const void *data,
+                   GLenum usage);
+void dsaBufferStorage(GLuint buffer, GLsizeiptr size, const void *data,
+                      GLbitfield flags);
+void dsaBufferSubData(GLuint buffer, GLintptr offset, GLsizeiptr size,
+                      const void *data);
+void dsaCopyBufferSubData(GLuint readBuffer, GLuint writeBuffer,
+                          GLintptr readOffset, GLintptr writeOffset,
+                          GLsizeiptr size);
+void *dsaMapBufferRange(GLuint buffer, GLintptr offset, GLsizeiptr length,
+                        GLbitfield access);
+void dsaUnmapBuffer(GLuint buffer);
+
+// Textures are 2D and have immutable storage (when the fallback has
+// ARB_texture_storage), so a texture that changes size is recreated.
+GLuint dsaCreateTexture2D();
+void dsaTextureStorage2D(GLuint texture, GLsizei levels,
+                         GLenum internalFormat, GLsizei width,
+                         GLsizei height);
+void dsaTextureSubImage2D(GLuint texture, GLint level, GLint x, GLint y,
+                          GLsizei width, GLsizei height, GLenum format,
+                          GLenum type, const void *pixels);
+void dsaTextureParameteri(GLuint texture, GLenum name, GLint value);
+// create a buffer texture that reads buffer's data as internalFormat
+GLuint dsaCreateTextureBuffer(GLenum internalFormat, GLuint buffer);
+
+GLuint dsaCreateRenderbuffer();
+void dsaRenderbufferStorage(GLuint renderbuffer, GLenum internalFormat,
+                            GLsizei width, GLsizei height);
+
+GLuint dsaCreateFramebuffer();
+void dsaFramebufferTexture(GLuint framebuffer, GLenum attachment,
+                           GLuint texture, GLint level);
+void dsaFramebufferRenderbuffer(GLuint framebuffer, GLenum attachment,
+                                GLuint renderbuffer);
+GLenum dsaCheckFramebufferStatus(GLuint framebuffer);
+
+// Vertex arrays read each attribute from its own buffer binding, so the
+// attribute index doubles as the binding index. Unlike glVertexAttribPointer,
+// stride has to be given even for tightly packed data.
+GLuint dsaCreateVertexArray();
+// enable a float attribute read from buffer
+void dsaVertexAttrib(GLuint vertexArray, GLuint index, GLuint buffer,
+                     GLint size, GLenum type, GLsizei stride,
+                     GLintptr offset);
+// enable an integer attribute read from buffer
+void dsaVertexAttribI(GLuint vertexArray, GLuint index, GLuint buffer,
+                      GLint size, GLenum type, GLsizei stride,
+                      GLintptr offset);
+void dsaVertexAttribDivisor(GLuint vertexArray, GLuint index,
+                            GLuint divisor);
+void dsaVertexArrayElementBuffer(GLuint vertexArray, GLuint buffer);
+
+#endif
@@ -0,0 +1,57 @@
+/**
+ * dynres.c
+ * Render scale control for dynamic resolution.
+ */
+
+#include <math.h>
+#include <string.h>
+#include "dynres.h"
+
+// Limits of a single change, as factors of the scale.
+#define MAX_DROP 0.75f
+#define MAX_GROWTH 1.1f
+
+void drInit(DynamicResolution *dr, float budgetMillis, float minScale) {
+    memset(dr, 0, sizeof(DynamicResolution));
+    dr->budget   = budgetMillis;
+    dr->minScale = minScale < 1 ? minScale : 1;
+    dr->scale    = 1;
+}
+
+int drAddFrame(DynamicResolution *dr, float gpuMillis) {
+    if(dr->budget <= 0 || gpuMillis < 0) {
+        return 0;
+    }
+    // The GPU times of the frames just after a change may be from before.
+    if(dr->settle) {
+        dr->settle--;
+        return 0;
+    }
+    dr->sum += gpuMillis;
+    if(++dr->samples < DR_INTERVAL) {
+        return 0;
+    }
+    float mean  = (float)(dr->sum / dr->samples);
+    dr->sum     = 0;
+    dr->samples = 0;
+    if(mean <= dr->budget && mean >= dr->budget * DR_HEADROOM) {
+        return 0;
+    }
+    // Aim for the middle of the band.
+    float target = 0.5f * (1 + DR_HEADROOM) * dr->budget;
+    float scale  = dr->scale * sqrtf(target / fmaxf(mean, 0.001f));
+    scale        = fminf(fmaxf(scale, dr->scale * MAX_DROP),
+                         dr->scale * MAX_GROWTH);
+    scale        = fminf(fmaxf(scale, dr->minScale), 1);
+    scale        = roundf(scale * DR_STEPS) / DR_STEPS;
+    if(scale < dr->minScale) {
+        scale += 1.0f / DR_STEPS;
+    }
+    if(scale == dr->scale) {
+        return 0;
+    }
+    dr->scale  = scale;
+    dr->settle = DR_SETTLE_FRAMES;
+    dr->changes++;
+    return 1;
+}
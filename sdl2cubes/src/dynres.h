@@ -0,0 +1,34 @@
+#ifndef CUBES_DYNRES_H
+#define CUBES_DYNRES_H
+
+// Dynamic resolution: picks how much of the offscreen target the scene is
+// rendered to, so the frame's GPU time stays within a budget. GPU time is
+// taken to follow the number of pixels, so the scale of both sides goes
+// with the square root of the time. Times are averaged over DR_INTERVAL
+// frames before each change. The scale drops quickly but grows slowly, and
+// stays put while the time is between DR_HEADROOM of the budget and all
+// of it, so it doesn't flip back and forth.
+
+enum { DR_INTERVAL = 8 };      // frames averaged per change
+enum { DR_SETTLE_FRAMES = 4 }; // frames ignored after a change
+enum { DR_STEPS = 64 };        // the scale is a multiple of 1 / DR_STEPS
+#define DR_HEADROOM 0.8f       // share of the budget that's too little
+#define DR_MIN_SCALE 0.5f      // default smallest scale
+
+typedef struct DynamicResolution {
+    float budget;     // GPU milliseconds per frame, 0 = fixed scale
+    float minScale;   // smallest scale to use
+    float scale;      // share of the width and height to render
+    double sum;       // GPU times since the last change
+    unsigned samples; // frames in sum
+    unsigned settle;  // frames left to ignore
+    unsigned changes; // times the scale has changed
+} DynamicResolution;
+
+// start at full scale
+void drInit(DynamicResolution *dr, float budgetMillis, float minScale);
+// add a frame's GPU time, which is ignored if negative; return 1 if the
+// scale changed
+int drAddFrame(DynamicResolution *dr, float gpuMillis);
+
+#endif
@@ -0,0 +1,389 @@
+/**
+ * framecapture.c
+ * Asynchronous frame readback for offline rendering.
+ *
+ * glReadPixels into a pixel buffer object returns once the copy has been
+ * queued, and the copy's fence tells when mapping the buffer won't block.
+ * The mapped pixels are copied into one of FC_SLOTS slots for the writer
+ * thread, so the buffer is free for the next readback right away. If the
+ * writer falls behind, capturing waits for a free slot instead of queueing
+ * frames without bound.
+ *
+ * PNGs are written with stored (uncompressed) deflate blocks. That costs a
+ * checksum pass and no compression time, so writing keeps up with
+ * rendering; video encoders compress the frames anyway.
+ */
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <SDL2/SDL.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "framecapture.h"
+#include "glstate.h"
+#include "dsa.h"
+#include "trace.h"
+
+// how long to wait for a readback at a time, in nanoseconds
+#define FENCE_TIMEOUT 1000000000ull
+// largest stored deflate block
+enum { STORED_MAX = 65535 };
+
+// a readback into a pixel buffer
+typedef struct Readback {
+    GLuint buffer;
+    GLsync fence; // set while the readback is in flight
+    int number;   // frame number
+} Readback;
+
+// a frame handed to the writer thread
+typedef struct WriterSlot {
+    unsigned char *pixels; // bottom-up RGBA, as GL reads them
+    int number;
+    int quit; // set instead of a frame to stop the writer
+} WriterSlot;
+
+static int width, height;
+static size_t frameSize;
+static char pattern[256];
+static int png = 0;
+static Readback readbacks[FC_BUFFERS];
+static int captured = 0; // frames read back so far
+static WriterSlot slots[FC_SLOTS];
+static unsigned nextSlot  = 0;    // slot to fill next
+static SDL_sem *freeSlots = NULL; // posted by the writer
+static SDL_sem *fullSlots = NULL; // posted by fcCapture()
+static SDL_Thread *writer = NULL;
+static unsigned char *encoded = NULL; // the writer's PNG buffer
+static uint32_t crcTable[256];
+
+// statistics
+static unsigned readWaits   = 0; // readbacks that weren't done in time
+static unsigned writerWaits = 0; // frames that waited for a free slot
+static unsigned failed      = 0; // frames that couldn't be written
+
+// ---- PNG encoding ----
+
+static void initCRC() {
+    for(uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for(int k = 0; k < 8; k++) {
+            c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+        }
+        crcTable[i] = c;
+    }
+}
+
+static uint32_t crc32(const unsigned char *data, size_t size) {
+    uint32_t c = 0xffffffffu;
+    for(size_t i = 0; i < size; i++) {
+        c = crcTable[(c ^ data[i]) & 0xff] ^ (c >> 8);
+    }
+    return c ^ 0xffffffffu;
+}
+
+// Update a zlib checksum. The sums are reduced often enough not to
+// overflow.
+static uint32_t adler32(uint32_t adler, const unsigned char *data,
+                        size_t size) {
+    uint32_t a = adler & 0xffff, b = adler >> 16;
+    while(size) {
+        size_t n = size < 5552 ? size : 5552;
+        size -= n;
+        while(n--) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+static unsigned char *put32(unsigned char *p, uint32_t value) {
+    p[0] = (unsigned char)(value >> 24);
+    p[1] = (unsigned char)(value >> 16);
+    p[2] = (unsigned char)(value >> 8);
+    p[3] = (unsigned char)value;
+    return p + 4;
+}
+
+// Get the size of the filtered image data, a filter type byte and the
+// pixels for each row.
+static size_t filteredSize() {
+    return ((size_t)width * 4 + 1) * height;
+}
+
+// Get the size of the PNG file encodePNG() writes.
+static size_t encodedSize() {
+    size_t blocks = (filteredSize() + STORED_MAX - 1) / STORED_MAX;
+    size_t zlib   = 2 + blocks * 5 + filteredSize() + 4;
+    return 8 + 25 + 12 + zlib + 12;
+}
+
+// Encode a bottom-up frame as a top-down PNG into out, which must have
+// room for encodedSize() bytes.
+static void encodePNG(unsigned char *out, const unsigned char *pixels) {
+    static const unsigned char signature[8] = {137, 80, 78, 71,
+                                               13,  10, 26, 10};
+    const size_t rowSize = (size_t)width * 4 + 1;
+    const size_t size    = filteredSize();
+    unsigned char *p     = out;
+    memcpy(p, signature, 8);
+    p += 8;
+
+    unsigned char *chunk = p;
+    p = put32(p, 13);
+    memcpy(p, "IHDR", 4);
+    p    = put32(p + 4, (uint32_t)width);
+    p    = put32(p, (uint32_t)height);
+    *p++ = 8; // bits per channel
+    *p++ = 6; // RGBA
+    *p++ = 0; // deflate
+    *p++ = 0; // adaptive filtering
+    *p++ = 0; // not interlaced
+    p    = put32(p, crc32(chunk + 4, p - chunk - 4));
+
+    chunk = p;
+    p     = put32(p, (uint32_t)(encodedSize() - 8 - 25 - 12 - 12));
+    memcpy(p, "IDAT", 4);
+    p += 4;
+    *p++           = 0x78; // deflate with a 32 KiB window
+    *p++           = 0x01; // no preset dictionary, header checksum
+    uint32_t adler = 1;
+    size_t pos     = 0; // position in the filtered data
+    while(pos < size) {
+        size_t blockSize = size - pos < STORED_MAX ? size - pos : STORED_MAX;
+        size_t blockEnd  = pos + blockSize;
+        *p++             = blockEnd == size; // last block flag, stored
+        p[0]             = (unsigned char)blockSize;
+        p[1]             = (unsigned char)(blockSize >> 8);
+        p[2]             = (unsigned char)~blockSize;
+        p[3]             = (unsigned char)(~blockSize >> 8);
+        p += 4;
+        // Blocks don't line up with rows, so copy whatever part of a row
+        // fits. Rows start with filter type 0, none.
+        while(pos < blockEnd) {
+            size_t row = pos / rowSize, column = pos % rowSize;
+            if(column == 0) {
+                *p++ = 0;
+                pos++;
+                continue;
+            }
+            size_t n = rowSize - column;
+            if(n > blockEnd - pos) {
+                n = blockEnd - pos;
+            }
+            const unsigned char *src =
+                pixels + (height - 1 - row) * (rowSize - 1) + column - 1;
+            memcpy(p, src, n);
+            p += n;
+            pos += n;
+        }
+        adler = adler32(adler, p - blockSize, blockSize);
+    }
+    p = put32(p, adler);
+    p = put32(p, crc32(chunk + 4, p - chunk - 4));
+
+    chunk = p;
+    p     = put32(p, 0);
+    memcpy(p, "IEND", 4);
+    put32(p + 4, crc32(chunk + 4, 4));
+}
+
+// ---- writer thread ----
+
+static int writeFrame(WriterSlot *slot) {
+    char filename[300];
+    snprintf(filename, sizeof(filename), pattern, slot->number);
+    FILE *file = fopen(filename, "wb");
+    if(!file) {
+        fprintf(stderr, "error: can't open %s for writing\n", filename);
+        return 0;
+    }
+    size_t wrote = 0, size = 0;
+    if(png) {
+        size = encodedSize();
+        encodePNG(encoded, slot->pixels);
+        wrote = fwrite(encoded, 1, size, file);
+    } else {
+        size_t rowSize = (size_t)width * 4;
+        for(int y = height - 1; y >= 0; y--) {
+            wrote += fwrite(slot->pixels + y * rowSize, 1, rowSize, file);
+        }
+        size = frameSize;
+    }
+    if(fclose(file) != 0 || wrote != size) {
+        fprintf(stderr, "error: can't write %s\n", filename);
+        return 0;
+    }
+    return 1;
+}
+
+static int writerMain(void *arg) {
+    (void)arg;
+    TRACE_THREAD("frame writer");
+    for(unsigned i = 0;; i++) {
+        SDL_SemWait(fullSlots);
+        WriterSlot *slot = &slots[i % FC_SLOTS];
+        if(slot->quit) {
+            break;
+        }
+        TRACE_BEGIN("write frame");
+        if(!writeFrame(slot)) {
+            failed++;
+        }
+        TRACE_END();
+        SDL_SemPost(freeSlots);
+    }
+    return 0;
+}
+
+// Wait for the writer to have room for another frame.
+static WriterSlot *takeSlot() {
+    if(SDL_SemTryWait(freeSlots) != 0) {
+        writerWaits++;
+        TRACE_BEGIN("wait for writer");
+        SDL_SemWait(freeSlots);
+        TRACE_END();
+    }
+    return &slots[nextSlot++ % FC_SLOTS];
+}
+
+// ---- capture ----
+
+// Check that pattern has one %d style conversion and nothing else for
+// snprintf() to misread.
+static int checkPattern(const char *format) {
+    int conversions = 0;
+    for(const char *c = format; *c; c++) {
+        if(*c != '%') {
+            continue;
+        }
+        if(c[1] == '%') {
+            c++;
+            continue;
+        }
+        c += 1 + strspn(c + 1, "0123456789-+ ");
+        if(*c != 'd' && *c != 'i') {
+            return 0;
+        }
+        conversions++;
+    }
+    return conversions == 1;
+}
+
+// Hand a finished readback to the writer thread.
+static void saveReadback(Readback *readback) {
+    TRACE_BEGIN("save readback");
+    GLenum res = glClientWaitSync(readback->fence, 0, 0);
+    if(res == GL_TIMEOUT_EXPIRED) {
+        readWaits++;
+        do {
+            res = glClientWaitSync(readback->fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                   FENCE_TIMEOUT);
+        } while(res == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(readback->fence);
+    readback->fence = NULL;
+
+    WriterSlot *slot = takeSlot();
+    const void *pixels =
+        dsaMapBufferRange(readback->buffer, 0, frameSize, GL_MAP_READ_BIT);
+    if(pixels) {
+        memcpy(slot->pixels, pixels, frameSize);
+        dsaUnmapBuffer(readback->buffer);
+    } else {
+        fprintf(stderr, "warning: can't map frame %i\n", readback->number);
+        memset(slot->pixels, 0, frameSize);
+    }
+    slot->number = readback->number;
+    slot->quit   = 0;
+    SDL_SemPost(fullSlots);
+    TRACE_END();
+}
+
+int fcInit(int frameWidth, int frameHeight, const char *filePattern) {
+    if(strlen(filePattern) >= sizeof(pattern) || !checkPattern(filePattern)) {
+        fprintf(stderr, "error: frame file names need one %%d: %s\n",
+                filePattern);
+        return 0;
+    }
+    strcpy(pattern, filePattern);
+    size_t length = strlen(pattern);
+    png       = length > 4 && strcmp(pattern + length - 4, ".png") == 0;
+    width     = frameWidth;
+    height    = frameHeight;
+    frameSize = (size_t)width * height * 4;
+    initCRC();
+
+    for(int i = 0; i < FC_BUFFERS; i++) {
+        readbacks[i].buffer = dsaCreateBuffer(GL_PIXEL_PACK_BUFFER);
+        dsaBufferData(readbacks[i].buffer, frameSize, NULL, GL_STREAM_READ);
+        readbacks[i].fence = NULL;
+    }
+    for(int i = 0; i < FC_SLOTS; i++) {
+        slots[i].pixels = (unsigned char *)malloc(frameSize);
+    }
+    if(png) {
+        encoded = (unsigned char *)malloc(encodedSize());
+    }
+    freeSlots = SDL_CreateSemaphore(FC_SLOTS);
+    fullSlots = SDL_CreateSemaphore(0);
+    writer    = SDL_CreateThread(writerMain, "frame writer", NULL);
+    if(!writer) {
+        fprintf(stderr, "error: can't start the frame writer\n");
+        return 0;
+    }
+    printf("writing %ix%i %s frames to %s\n", width, height,
+           png ? "PNG" : "raw RGBA", pattern);
+    return 1;
+}
+
+void fcCapture() {
+    // The oldest readback in the ring is reused for this frame.
+    Readback *readback = &readbacks[captured % FC_BUFFERS];
+    if(readback->fence) {
+        saveReadback(readback);
+    }
+    gsBindFramebuffer(GL_FRAMEBUFFER, 0);
+    gsBindBuffer(GL_PIXEL_PACK_BUFFER, readback->buffer);
+    glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    gsBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readback->fence  = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readback->number = captured++;
+}
+
+void fcFinish() {
+    if(!writer) {
+        return;
+    }
+    // Save the readbacks in flight oldest first.
+    for(int i = 0; i < FC_BUFFERS; i++) {
+        Readback *readback = &readbacks[(captured + i) % FC_BUFFERS];
+        if(readback->fence) {
+            saveReadback(readback);
+        }
+    }
+    WriterSlot *slot = takeSlot();
+    slot->quit       = 1;
+    SDL_SemPost(fullSlots);
+    SDL_WaitThread(writer, NULL);
+    writer = NULL;
+
+    for(int i = 0; i < FC_BUFFERS; i++) {
+        gsDeleteBuffers(1, &readbacks[i].buffer);
+    }
+    for(int i = 0; i < FC_SLOTS; i++) {
+        free(slots[i].pixels);
+    }
+    free(encoded);
+    encoded = NULL;
+    SDL_DestroySemaphore(freeSlots);
+    SDL_DestroySemaphore(fullSlots);
+    printf("captured %i frames, %u failed to write; waited %u times for "
+           "readback, %u times for the writer\n",
+           captured, failed, readWaits, writerWaits);
+}
@@ -0,0 +1,23 @@
+#ifndef CUBES_FRAMECAPTURE_H
+#define CUBES_FRAMECAPTURE_H
+
+// Saving rendered frames to files without stalling the renderer. Frames
+// are read back into a ring of FC_BUFFERS pixel buffer objects, each of
+// which is only mapped when the ring comes around to it again, long after
+// the GPU finished the copy. A writer thread encodes and writes the frames
+// while the next ones render.
+
+enum { FC_BUFFERS = 4 }; // readbacks in flight
+enum { FC_SLOTS = 4 };   // frames queued for the writer thread
+
+// Start capturing width x height frames to files named by pattern, a
+// printf format with one %d for the frame number, e.g. "out/%05d.png".
+// Names ending in .png are written as PNG, others as raw top-down RGBA.
+// return 0 on failure
+int fcInit(int width, int height, const char *pattern);
+// read back the default framebuffer as the next frame
+void fcCapture();
+// write the frames still in flight, stop the writer and print statistics
+void fcFinish();
+
+#endif
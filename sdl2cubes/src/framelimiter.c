@@ -0,0 +1,114 @@
+/**
+ * framelimiter.c
+ * Frame rate limiting with a hybrid sleep.
+ *
+ * SDL_Delay(1) sleeps for at least a millisecond but sometimes for quite a
+ * bit longer, depending on the OS scheduler. How long it took is tracked
+ * with a running mean and variance, and sleeping stops once the time left
+ * is less than the mean plus two standard deviations. The rest of the wait
+ * is spun, which is exact but burns CPU, so the margin is kept small.
+ */
+
+#include <SDL2/SDL.h>
+#include <math.h>
+#include <string.h>
+#include "framelimiter.h"
+
+// weight of the latest sleep in the sleep time estimate
+#define SLEEP_WEIGHT (1.0 / 32)
+
+static Uint64 frequency = 0;
+static Uint64 period    = 0; // ticks per frame, 0 if off
+static Uint64 deadline  = 0; // when the next frame is due
+static double sleepMean = 0; // how long SDL_Delay(1) takes, in ticks
+static double sleepVar  = 0; // and the variance of that
+
+// statistics
+static PacingStats stats;
+static double errorSum   = 0; // ticks woken after the deadlines
+static Uint64 errorMax   = 0;
+static Uint64 sleptTicks = 0;
+static Uint64 waitTicks  = 0;
+
+void flInit(float maxFPS) {
+    frequency = SDL_GetPerformanceFrequency();
+    period    = maxFPS > 0 ? (Uint64)(frequency / maxFPS) : 0;
+    deadline  = SDL_GetPerformanceCounter() + period;
+    // Start by assuming a sleep can take up to 2 ms.
+    sleepMean = frequency * 0.0015;
+    sleepVar  = (frequency * 0.00025) * (frequency * 0.00025);
+    flGetStats(1);
+}
+
+int flEnabled() {
+    return period != 0;
+}
+
+// Sleep for about a millisecond and update the estimate of how long that
+// takes.
+static void sleepOnce() {
+    Uint64 start = SDL_GetPerformanceCounter();
+    SDL_Delay(1);
+    Uint64 slept = SDL_GetPerformanceCounter() - start;
+    double diff  = slept - sleepMean;
+    sleepMean += SLEEP_WEIGHT * diff;
+    sleepVar = (1 - SLEEP_WEIGHT) * (sleepVar + SLEEP_WEIGHT * diff * diff);
+    sleptTicks += slept;
+}
+
+void flWait() {
+    if(!period) {
+        return;
+    }
+    Uint64 now = SDL_GetPerformanceCounter();
+    if(now >= deadline) {
+        // The frame overran its budget. If it's behind by more than a
+        // frame, start over from now instead of rushing to catch up.
+        stats.late++;
+        if(now - deadline > period) {
+            deadline = now;
+        }
+        deadline += period;
+        return;
+    }
+    Uint64 start = now;
+    while(deadline - now > sleepMean + 2 * sqrt(sleepVar)) {
+        sleepOnce();
+        now = SDL_GetPerformanceCounter();
+        if(now >= deadline) {
+            break;
+        }
+    }
+    while(now < deadline) {
+        now = SDL_GetPerformanceCounter();
+    }
+    Uint64 error = now - deadline;
+    waitTicks += now - start;
+    errorSum += error;
+    if(error > errorMax) {
+        errorMax = error;
+    }
+    if(error * 1000.0 / frequency <= FL_TOLERANCE_MS) {
+        stats.onTime++;
+    }
+    stats.frames++;
+    deadline += period;
+}
+
+PacingStats flGetStats(int reset) {
+    PacingStats result = stats;
+    if(stats.frames) {
+        double toMillis   = 1000.0 / frequency;
+        result.meanError  = (float)(errorSum / stats.frames * toMillis);
+        result.maxError   = (float)(errorMax * toMillis);
+        result.sleepShare = waitTicks ? (float)sleptTicks / waitTicks : 0;
+    }
+    if(reset) {
+        memset(&stats, 0, sizeof(stats));
+        errorSum   = 0;
+        errorMax   = 0;
+        sleptTicks = 0;
+        waitTicks  = 0;
+    }
+    return result;
+}
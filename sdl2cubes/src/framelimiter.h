@@ -0,0 +1,29 @@
+#ifndef CUBES_FRAMELIMITER_H
+#define CUBES_FRAMELIMITER_H
+
+// Capping the frame rate without spinning a core at 100%. Each wait sleeps
+// in 1 ms steps while the time left is longer than a sleep is likely to
+// take, then spins on the performance counter for the rest, so deadlines
+// are hit to within a fraction of a millisecond with little CPU time.
+
+#define FL_TOLERANCE_MS 0.2f // wakeups this close to the deadline are on time
+
+typedef struct PacingStats {
+    unsigned frames;    // frames that were waited for
+    unsigned onTime;    // of them, woken within FL_TOLERANCE_MS
+    unsigned late;      // frames that were already past their deadline
+    float meanError;    // mean time woken after the deadline in ms
+    float maxError;     // latest wakeup after the deadline in ms
+    float sleepShare;   // fraction of the waiting that was spent asleep
+} PacingStats;
+
+// limit frames to maxFPS per second; 0 turns the limiter off
+void flInit(float maxFPS);
+// check if the limiter is on
+int flEnabled();
+// wait until the next frame is due
+void flWait();
+// get the pacing statistics so far; reset them if asked to
+PacingStats flGetStats(int reset);
+
+#endif
@@ -0,0 +1,88 @@
+/**
+ * framestats.c
+ * Rolling frame time statistics.
+ */
+
+#include <string.h>
+#include "framestats.h"
+
+// Frames are checked for stutter against a median that is refreshed this
+// often, since finding it walks the whole histogram.
+enum { MEDIAN_INTERVAL = 16 };
+
+void ftInit(FrameTimes *ft) {
+    memset(ft, 0, sizeof(FrameTimes));
+}
+
+static unsigned bucketOf(float millis) {
+    float bucket = millis / FT_BUCKET_MS;
+    return bucket < FT_BUCKETS - 1 ? (unsigned)bucket : FT_BUCKETS - 1;
+}
+
+// Find the frame time that a fraction of the frames are at or under,
+// using the nearest rank. Frames in a bucket are taken to be at its middle.
+static float percentile(const FrameTimes *ft, float fraction, float max) {
+    unsigned rank = (unsigned)(fraction * ft->count + 0.999f);
+    if(rank < 1) {
+        rank = 1;
+    }
+    unsigned seen = 0;
+    for(unsigned i = 0; i < FT_BUCKETS - 1; i++) {
+        seen += ft->counts[i];
+        if(seen >= rank) {
+            float millis = (i + 0.5f) * FT_BUCKET_MS;
+            return millis < max ? millis : max;
+        }
+    }
+    return max;
+}
+
+void ftAdd(FrameTimes *ft, float millis) {
+    if(millis < 0) {
+        millis = 0;
+    }
+    if(ft->count == FT_WINDOW) {
+        float oldest = ft->frames[ft->next];
+        ft->counts[bucketOf(oldest)]--;
+        ft->sum -= oldest;
+    } else {
+        ft->count++;
+    }
+    ft->frames[ft->next] = millis;
+    ft->counts[bucketOf(millis)]++;
+    ft->sum += millis;
+    ft->next = (ft->next + 1) % FT_WINDOW;
+
+    if(++ft->added % MEDIAN_INTERVAL == 0) {
+        ft->median = percentile(ft, 0.5f, 1e9f);
+    }
+    // The first frames have no median to compare to yet.
+    if(ft->median > 0 && millis > ft->median * FT_STUTTER_RATIO) {
+        ft->totalStutters++;
+    }
+}
+
+FrameTimeStats ftGetStats(const FrameTimes *ft) {
+    FrameTimeStats stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.totalStutters = ft->totalStutters;
+    if(!ft->count) {
+        return stats;
+    }
+    for(unsigned i = 0; i < ft->count; i++) {
+        if(ft->frames[i] > stats.max) {
+            stats.max = ft->frames[i];
+        }
+    }
+    stats.frames = ft->count;
+    stats.mean   = (float)(ft->sum / ft->count);
+    stats.p50    = percentile(ft, 0.50f, stats.max);
+    stats.p95    = percentile(ft, 0.95f, stats.max);
+    stats.p99    = percentile(ft, 0.99f, stats.max);
+    for(unsigned i = 0; i < ft->count; i++) {
+        if(ft->frames[i] > stats.p50 * FT_STUTTER_RATIO) {
+            stats.stutters++;
+        }
+    }
+    return stats;
+}
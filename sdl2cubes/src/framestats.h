@@ -0,0 +1,39 @@
+#ifndef CUBES_FRAMESTATS_H
+#define CUBES_FRAMESTATS_H
+
+// Frame time statistics over the last FT_WINDOW frames. Frame times are
+// kept in a histogram as well as a ring, so percentiles can be read at any
+// time without sorting anything.
+
+enum { FT_WINDOW = 1024 };  // frames the statistics cover
+enum { FT_BUCKETS = 2048 }; // histogram buckets; longer frames share the last
+#define FT_BUCKET_MS 0.05f  // width of a bucket in milliseconds
+#define FT_STUTTER_RATIO 2  // frames this many times the median are stutters
+
+typedef struct FrameTimes {
+    float frames[FT_WINDOW];     // latest frame times in ms, a ring
+    unsigned counts[FT_BUCKETS]; // histogram of the frames in the ring
+    unsigned next;               // ring position for the next frame
+    unsigned count;              // frames in the ring
+    double sum;                  // sum of the frames in the ring
+    unsigned added;              // frames added since ftInit()
+    float median;                // refreshed every few frames
+    unsigned totalStutters;      // stutters since ftInit()
+} FrameTimes;
+
+typedef struct FrameTimeStats {
+    unsigned frames;                // frames the statistics are from
+    float mean, p50, p95, p99, max; // milliseconds
+    unsigned stutters;              // stutters among the frames
+    unsigned totalStutters;         // stutters since ftInit()
+} FrameTimeStats;
+
+// start with no frames
+void ftInit(FrameTimes *ft);
+// add a frame, pushing out the oldest one if the window is full
+void ftAdd(FrameTimes *ft, float millis);
+// get the statistics of the frames in the window; percentiles are accurate
+// to FT_BUCKET_MS, the mean and max are exact
+FrameTimeStats ftGetStats(const FrameTimes *ft);
+
+#endif
@@ -0,0 +1,417 @@
+/**
+ * glstate.c
+ * Skip redundant GL state changes.
+ *
+ * GL calls are not free even when they change nothing: the driver still
+ * has to validate them, and some drivers do a surprising amount of work
+ * for a rebind of the same object. Keeping our own copy of the state is
+ * cheap, as long as nobody changes it behind our back.
+ */
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <stdio.h>
+#include <string.h>
+#include "glstate.h"
+
+enum {
+    GS_UNIFORM_BINDINGS = 16, // tracked indexed GL_UNIFORM_BUFFER bindings
+    GS_TEXTURE_UNITS    = 16, // tracked texture units (GL_TEXTURE_2D only)
+};
+
+// buffer targets with a tracked binding, and the glGet names for them
+static const GLenum BUFFER_TARGETS[][2] = {
+    {GL_ARRAY_BUFFER, GL_ARRAY_BUFFER_BINDING},
+    {GL_UNIFORM_BUFFER, GL_UNIFORM_BUFFER_BINDING},
+    {GL_DRAW_INDIRECT_BUFFER, GL_DRAW_INDIRECT_BUFFER_BINDING},
+    {GL_COPY_READ_BUFFER, GL_COPY_READ_BUFFER_BINDING},
+    {GL_COPY_WRITE_BUFFER, GL_COPY_WRITE_BUFFER_BINDING},
+    {GL_PIXEL_PACK_BUFFER, GL_PIXEL_PACK_BUFFER_BINDING},
+    {GL_PIXEL_UNPACK_BUFFER, GL_PIXEL_UNPACK_BUFFER_BINDING},
+};
+enum {
+    GS_BUFFER_TARGETS = sizeof(BUFFER_TARGETS) / sizeof(BUFFER_TARGETS[0])
+};
+
+// tracked glEnable caps, one bit each
+static const GLenum CAPS[] = {
+    GL_DEPTH_TEST,
+    GL_CULL_FACE,
+    GL_BLEND,
+    GL_SCISSOR_TEST,
+    GL_STENCIL_TEST,
+    GL_RASTERIZER_DISCARD,
+    GL_FRAMEBUFFER_SRGB,
+    GL_PROGRAM_POINT_SIZE,
+};
+enum { GS_CAPS = sizeof(CAPS) / sizeof(CAPS[0]) };
+
+typedef struct UniformRange {
+    GLuint buffer;
+    GLint64 offset;
+    GLint64 size;
+} UniformRange;
+
+typedef struct GLState {
+    GLuint program;
+    GLuint vertexArray;
+    GLuint drawFramebuffer;
+    GLuint readFramebuffer;
+    GLuint buffers[GS_BUFFER_TARGETS];
+    UniformRange uniforms[GS_UNIFORM_BINDINGS];
+    GLuint activeTexture; // unit number, not GL_TEXTUREi
+    GLuint textures[GS_TEXTURE_UNITS];
+    unsigned enabled; // bit i is set if CAPS[i] is enabled
+    GLboolean depthMask;
+    GLint viewport[4];
+    GLfloat clearColor[4];
+} GLState;
+
+static GLState cache;
+static GLStateStats frameStats, lastStats;
+static int debugMode = 0;
+
+static int findBufferTarget(GLenum target) {
+    for(int i = 0; i < GS_BUFFER_TARGETS; i++) {
+        if(BUFFER_TARGETS[i][0] == target) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int findCap(GLenum cap) {
+    for(int i = 0; i < GS_CAPS; i++) {
+        if(CAPS[i] == cap) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static GLuint getUint(GLenum name) {
+    GLint value = 0;
+    glGetIntegerv(name, &value);
+    return (GLuint)value;
+}
+
+// Query everything we track from GL.
+static void readState(GLState *state) {
+    memset(state, 0, sizeof(GLState));
+    state->program         = getUint(GL_CURRENT_PROGRAM);
+    state->vertexArray     = getUint(GL_VERTEX_ARRAY_BINDING);
+    state->drawFramebuffer = getUint(GL_DRAW_FRAMEBUFFER_BINDING);
+    state->readFramebuffer = getUint(GL_READ_FRAMEBUFFER_BINDING);
+    for(int i = 0; i < GS_BUFFER_TARGETS; i++) {
+        // GL 3.3 doesn't have indirect draws without the extension.
+        if(BUFFER_TARGETS[i][0] == GL_DRAW_INDIRECT_BUFFER &&
+           !GLEW_ARB_draw_indirect) {
+            continue;
+        }
+        state->buffers[i] = getUint(BUFFER_TARGETS[i][1]);
+    }
+    for(GLuint i = 0; i < GS_UNIFORM_BINDINGS; i++) {
+        GLint64 value = 0;
+        glGetInteger64i_v(GL_UNIFORM_BUFFER_BINDING, i, &value);
+        state->uniforms[i].buffer = (GLuint)value;
+        glGetInteger64i_v(GL_UNIFORM_BUFFER_START, i,
+                          &state->uniforms[i].offset);
+        glGetInteger64i_v(GL_UNIFORM_BUFFER_SIZE, i,
+                          &state->uniforms[i].size);
+    }
+    state->activeTexture = getUint(GL_ACTIVE_TEXTURE) - GL_TEXTURE0;
+    for(GLuint i = 0; i < GS_TEXTURE_UNITS; i++) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        state->textures[i] = getUint(GL_TEXTURE_BINDING_2D);
+    }
+    glActiveTexture(GL_TEXTURE0 + state->activeTexture);
+    for(int i = 0; i < GS_CAPS; i++) {
+        if(glIsEnabled(CAPS[i])) {
+            state->enabled |= 1u << i;
+        }
+    }
+    glGetBooleanv(GL_DEPTH_WRITEMASK, &state->depthMask);
+    glGetIntegerv(GL_VIEWPORT, state->viewport);
+    glGetFloatv(GL_COLOR_CLEAR_VALUE, state->clearColor);
+}
+
+void gsInit() {
+    readState(&cache);
+}
+
+void gsSetDebug(int enabled) {
+    debugMode = enabled;
+}
+
+void gsEndFrame() {
+    lastStats = frameStats;
+    memset(&frameStats, 0, sizeof(GLStateStats));
+    if(debugMode) {
+        gsValidate();
+    }
+}
+
+GLStateStats gsGetStats() {
+    return lastStats;
+}
+
+static int check(const char *what, int index, long long cached,
+                 long long actual) {
+    if(cached == actual) {
+        return 0;
+    }
+    fprintf(stderr, "gl state mismatch: %s[%d] is %lld, expected %lld\n",
+            what, index, actual, cached);
+    return 1;
+}
+
+static int checkFloat(const char *what, int index, float cached,
+                      float actual) {
+    if(cached == actual) {
+        return 0;
+    }
+    fprintf(stderr, "gl state mismatch: %s[%d] is %g, expected %g\n", what,
+            index, actual, cached);
+    return 1;
+}
+
+int gsValidate() {
+    GLState actual;
+    readState(&actual);
+    int errors = 0;
+    errors += check("program", 0, cache.program, actual.program);
+    errors += check("vertex array", 0, cache.vertexArray, actual.vertexArray);
+    errors += check("draw framebuffer", 0, cache.drawFramebuffer,
+                    actual.drawFramebuffer);
+    errors += check("read framebuffer", 0, cache.readFramebuffer,
+                    actual.readFramebuffer);
+    for(int i = 0; i < GS_BUFFER_TARGETS; i++) {
+        errors += check("buffer", i, cache.buffers[i], actual.buffers[i]);
+    }
+    for(int i = 0; i < GS_UNIFORM_BINDINGS; i++) {
+        UniformRange *c = &cache.uniforms[i], *a = &actual.uniforms[i];
+        errors += check("uniform buffer", i, c->buffer, a->buffer);
+        if(c->buffer) {
+            errors += check("uniform offset", i, c->offset, a->offset);
+            errors += check("uniform size", i, c->size, a->size);
+        }
+    }
+    errors += check("active texture", 0, cache.activeTexture,
+                    actual.activeTexture);
+    for(int i = 0; i < GS_TEXTURE_UNITS; i++) {
+        errors += check("texture", i, cache.textures[i], actual.textures[i]);
+    }
+    errors += check("enabled", 0, cache.enabled, actual.enabled);
+    errors += check("depth mask", 0, cache.depthMask, actual.depthMask);
+    for(int i = 0; i < 4; i++) {
+        errors += check("viewport", i, cache.viewport[i], actual.viewport[i]);
+        errors += checkFloat("clear color", i, cache.clearColor[i],
+                             actual.clearColor[i]);
+    }
+    if(errors) {
+        // Start over from what GL actually has.
+        cache = actual;
+    }
+    return errors;
+}
+
+// Count a call and tell if it has to be issued.
+static int changed(int differs) {
+    if(differs) {
+        frameStats.issued++;
+    } else {
+        frameStats.skipped++;
+    }
+    return differs;
+}
+
+void gsUseProgram(GLuint program) {
+    if(changed(cache.program != program)) {
+        cache.program = program;
+        glUseProgram(program);
+    }
+}
+
+void gsBindVertexArray(GLuint vertexArray) {
+    if(changed(cache.vertexArray != vertexArray)) {
+        cache.vertexArray = vertexArray;
+        glBindVertexArray(vertexArray);
+    }
+}
+
+void gsBindBuffer(GLenum target, GLuint buffer) {
+    // GL_ELEMENT_ARRAY_BUFFER belongs to the vertex array, so it's not
+    // tracked here along with other targets we don't know.
+    int i = findBufferTarget(target);
+    if(changed(i < 0 || cache.buffers[i] != buffer)) {
+        if(i >= 0) {
+            cache.buffers[i] = buffer;
+        }
+        glBindBuffer(target, buffer);
+    }
+}
+
+void gsBindBufferRange(GLenum target, GLuint index, GLuint buffer,
+                       GLintptr offset, GLsizeiptr size) {
+    UniformRange *range = NULL;
+    if(target == GL_UNIFORM_BUFFER && index < GS_UNIFORM_BINDINGS) {
+        range = &cache.uniforms[index];
+    }
+    if(changed(!range || range->buffer != buffer || range->offset != offset ||
+               range->size != size)) {
+        if(range) {
+            range->buffer = buffer;
+            range->offset = offset;
+            range->size   = size;
+        }
+        glBindBufferRange(target, index, buffer, offset, size);
+    }
+    // Indexed binds also replace the target's generic binding.
+    int i = findBufferTarget(target);
+    if(i >= 0) {
+        cache.buffers[i] = buffer;
+    }
+}
+
+void gsBindFramebuffer(GLenum target, GLuint framebuffer) {
+    int draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+    int read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+    if(changed((draw && cache.drawFramebuffer != framebuffer) ||
+               (read && cache.readFramebuffer != framebuffer))) {
+        if(draw) {
+            cache.drawFramebuffer = framebuffer;
+        }
+        if(read) {
+            cache.readFramebuffer = framebuffer;
+        }
+        glBindFramebuffer(target, framebuffer);
+    }
+}
+
+static void setCap(GLenum cap, int enable) {
+    int i        = findCap(cap);
+    unsigned bit = i >= 0 ? 1u << i : 0;
+    if(changed(i < 0 || !(cache.enabled & bit) != !enable)) {
+        if(enable) {
+            cache.enabled |= bit;
+            glEnable(cap);
+        } else {
+            cache.enabled &= ~bit;
+            glDisable(cap);
+        }
+    }
+}
+
+void gsEnable(GLenum cap) {
+    setCap(cap, 1);
+}
+
+void gsDisable(GLenum cap) {
+    setCap(cap, 0);
+}
+
+void gsDepthMask(GLboolean flag) {
+    if(changed(cache.depthMask != flag)) {
+        cache.depthMask = flag;
+        glDepthMask(flag);
+    }
+}
+
+void gsViewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+    GLint *v = cache.viewport;
+    if(changed(v[0] != x || v[1] != y || v[2] != width || v[3] != height)) {
+        v[0] = x;
+        v[1] = y;
+        v[2] = width;
+        v[3] = height;
+        glViewport(x, y, width, height);
+    }
+}
+
+void gsClearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a) {
+    GLfloat *c = cache.clearColor;
+    if(changed(c[0] != r || c[1] != g || c[2] != b || c[3] != a)) {
+        c[0] = r;
+        c[1] = g;
+        c[2] = b;
+        c[3] = a;
+        glClearColor(r, g, b, a);
+    }
+}
+
+void gsBindTexture(GLuint unit, GLenum target, GLuint texture) {
+    int tracked = target == GL_TEXTURE_2D && unit < GS_TEXTURE_UNITS;
+    if(tracked && cache.textures[unit] == texture) {
+        changed(0);
+        return;
+    }
+    if(cache.activeTexture != unit) {
+        changed(1);
+        cache.activeTexture = unit;
+        glActiveTexture(GL_TEXTURE0 + unit);
+    }
+    changed(1);
+    if(tracked) {
+        cache.textures[unit] = texture;
+    }
+    glBindTexture(target, texture);
+}
+
+// ---- deletion ----
+
+void gsDeleteProgram(GLuint program) {
+    // The current program stays in use until another one is picked, so
+    // keep using its name until then.
+    glDeleteProgram(program);
+}
+
+void gsDeleteVertexArrays(GLsizei n, const GLuint *vertexArrays) {
+    for(GLsizei i = 0; i < n; i++) {
+        if(cache.vertexArray == vertexArrays[i]) {
+            cache.vertexArray = 0;
+        }
+    }
+    glDeleteVertexArrays(n, vertexArrays);
+}
+
+void gsDeleteBuffers(GLsizei n, const GLuint *buffers) {
+    for(GLsizei i = 0; i < n; i++) {
+        for(int t = 0; t < GS_BUFFER_TARGETS; t++) {
+            if(cache.buffers[t] == buffers[i]) {
+                cache.buffers[t] = 0;
+            }
+        }
+        // Indexed bindings revert to zero as well. GL only promises to
+        // reset the buffer name; what's left of the range depends on the
+        // driver, so the cached one is only compared while bound.
+        for(int u = 0; u < GS_UNIFORM_BINDINGS; u++) {
+            if(cache.uniforms[u].buffer == buffers[i]) {
+                cache.uniforms[u].buffer = 0;
+            }
+        }
+    }
+    glDeleteBuffers(n, buffers);
+}
+
+void gsDeleteFramebuffers(GLsizei n, const GLuint *framebuffers) {
+    for(GLsizei i = 0; i < n; i++) {
+        if(cache.drawFramebuffer == framebuffers[i]) {
+            cache.drawFramebuffer = 0;
+        }
+        if(cache.readFramebuffer == framebuffers[i]) {
+            cache.readFramebuffer = 0;
+        }
+    }
+    glDeleteFramebuffers(n, framebuffers);
+}
+
+void gsDeleteTextures(GLsizei n, const GLuint *textures) {
+    for(GLsizei i = 0; i < n; i++) {
+        for(int u = 0; u < GS_TEXTURE_UNITS; u++) {
+            if(cache.textures[u] == textures[i]) {
+                cache.textures[u] = 0;
+            }
+        }
+    }
+    glDeleteTextures(n, textures);
+}
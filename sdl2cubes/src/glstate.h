@@ -0,0 +1,50 @@
+#ifndef CUBES_GLSTATE_H
+#define CUBES_GLSTATE_H
+
+// Shadow copy of the GL state this program changes, so that calls that
+// would not change anything can be skipped. All code that touches the
+// tracked state should go through these functions, or the copy gets out of
+// sync; gsInit() reads it back from GL if that can't be avoided.
+// State the layer doesn't track (other buffer targets, texture targets and
+// caps) is passed through to GL as-is.
+
+// state call counts
+typedef struct GLStateStats {
+    unsigned issued;  // calls passed on to GL
+    unsigned skipped; // calls skipped because they would change nothing
+} GLStateStats;
+
+// read the current state from GL
+void gsInit();
+// in debug mode, check the shadow state against GL at the end of each frame
+void gsSetDebug(int enabled);
+// finish the frame's statistics (and validate in debug mode)
+void gsEndFrame();
+// get the last frame's call counts
+GLStateStats gsGetStats();
+// compare the shadow state with GL, print differences; return their count
+int gsValidate();
+
+// these work like the GL functions without the "gs" prefix
+void gsUseProgram(GLuint program);
+void gsBindVertexArray(GLuint vertexArray);
+void gsBindBuffer(GLenum target, GLuint buffer);
+void gsBindBufferRange(GLenum target, GLuint index, GLuint buffer,
+                       GLintptr offset, GLsizeiptr size);
+void gsBindFramebuffer(GLenum target, GLuint framebuffer);
+void gsEnable(GLenum cap);
+void gsDisable(GLenum cap);
+void gsDepthMask(GLboolean flag);
+void gsViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+void gsClearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a);
+// bind texture to a texture unit (0, 1, ...), switching units if needed
+void gsBindTexture(GLuint unit, GLenum target, GLuint texture);
+
+// these also forget any bindings of the deleted objects, like GL does
+void gsDeleteProgram(GLuint program);
+void gsDeleteVertexArrays(GLsizei n, const GLuint *vertexArrays);
+void gsDeleteBuffers(GLsizei n, const GLuint *buffers);
+void gsDeleteFramebuffers(GLsizei n, const GLuint *framebuffers);
+void gsDeleteTextures(GLsizei n, const GLuint *textures);
+
+#endif
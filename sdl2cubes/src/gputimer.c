@@ -0,0 +1,209 @@
+/**
+ * gputimer.c
+ * Non-blocking GPU timing.
+ *
+ * Every scope gets two GL_TIMESTAMP queries per frame, one at each end,
+ * in a pool of GT_FRAMES frames. Before a frame's queries are reused
+ * they're checked for results. If the GPU still hasn't finished that
+ * frame, its results are dropped instead of waited for. Timestamps work
+ * with nesting where GL_TIME_ELAPSED doesn't, and Mesa's software
+ * rasterizer supports them too.
+ */
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <stdio.h>
+#include <string.h>
+#include "gputimer.h"
+
+typedef struct TimerScope {
+    char name[24];
+    float history[GT_HISTORY]; // latest results, a ring
+    unsigned results;          // results so far
+    float sum;                 // of the ring
+    float last;                // latest result
+} TimerScope;
+
+// one frame's queries
+typedef struct TimerFrame {
+    GLuint queries[GT_MAX_SCOPES][2];
+    int used[GT_MAX_SCOPES]; // 1 if begun, 2 if also ended
+    unsigned number;         // frame number, for the CSV
+} TimerFrame;
+
+static int enabled = 0;
+static TimerScope scopes[GT_MAX_SCOPES];
+static int numScopes = 0;
+static TimerFrame frames[GT_FRAMES];
+static unsigned current     = 0; // frame being recorded
+static unsigned frameNumber = 0; // frames recorded so far
+static unsigned dropped     = 0; // frames whose results weren't ready
+static FILE *csv            = NULL;
+static int csvHeader        = 0; // 1 once the header has been written
+
+int gtInit() {
+    GLint bits = 0;
+    glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+    if(!bits) {
+        printf("warning: no GPU timer, GPU times won't be measured\n");
+        return 0;
+    }
+    for(int i = 0; i < GT_FRAMES; i++) {
+        glGenQueries(GT_MAX_SCOPES * 2, &frames[i].queries[0][0]);
+    }
+    enabled = 1;
+    return 1;
+}
+
+int gtScope(const char *name) {
+    if(numScopes == GT_MAX_SCOPES) {
+        return -1;
+    }
+    TimerScope *scope = &scopes[numScopes];
+    memset(scope, 0, sizeof(TimerScope));
+    snprintf(scope->name, sizeof(scope->name), "%s", name);
+    scope->last = -1;
+    return numScopes++;
+}
+
+void gtBegin(int scope) {
+    TimerFrame *frame = &frames[current];
+    if(!enabled || scope < 0 || frame->used[scope]) {
+        return;
+    }
+    glQueryCounter(frame->queries[scope][0], GL_TIMESTAMP);
+    frame->used[scope] = 1;
+}
+
+void gtEnd(int scope) {
+    TimerFrame *frame = &frames[current];
+    if(!enabled || scope < 0 || frame->used[scope] != 1) {
+        return;
+    }
+    glQueryCounter(frame->queries[scope][1], GL_TIMESTAMP);
+    frame->used[scope] = 2;
+}
+
+static void addResult(TimerScope *scope, float millis) {
+    unsigned slot = scope->results % GT_HISTORY;
+    if(scope->results >= GT_HISTORY) {
+        scope->sum -= scope->history[slot];
+    }
+    scope->history[slot] = millis;
+    scope->sum += millis;
+    scope->last = millis;
+    scope->results++;
+}
+
+static void writeCSV(TimerFrame *frame, const float *millis) {
+    if(!csvHeader) {
+        fprintf(csv, "frame");
+        for(int i = 0; i < numScopes; i++) {
+            fprintf(csv, ",%s", scopes[i].name);
+        }
+        fprintf(csv, "\n");
+        csvHeader = 1;
+    }
+    fprintf(csv, "%u", frame->number);
+    for(int i = 0; i < numScopes; i++) {
+        if(frame->used[i] == 2) {
+            fprintf(csv, ",%.4f", millis[i]);
+        } else {
+            fprintf(csv, ",");
+        }
+    }
+    fprintf(csv, "\n");
+}
+
+// Read a finished frame's results, unless the GPU isn't done with it.
+static int readFrame(TimerFrame *frame) {
+    // A scope that was begun but never ended has no result.
+    int any = 0;
+    for(int i = 0; i < numScopes; i++) {
+        if(frame->used[i] == 2) {
+            // The end query is done only if the begin query is too.
+            GLint ready = 0;
+            glGetQueryObjectiv(frame->queries[i][1],
+                               GL_QUERY_RESULT_AVAILABLE, &ready);
+            if(!ready) {
+                dropped++;
+                return 0;
+            }
+            any = 1;
+        }
+    }
+    if(!any) {
+        return 0;
+    }
+    float millis[GT_MAX_SCOPES];
+    for(int i = 0; i < numScopes; i++) {
+        if(frame->used[i] == 2) {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(frame->queries[i][0], GL_QUERY_RESULT,
+                                  &begin);
+            glGetQueryObjectui64v(frame->queries[i][1], GL_QUERY_RESULT,
+                                  &end);
+            millis[i] = (end - begin) / 1e6f;
+            addResult(&scopes[i], millis[i]);
+        }
+    }
+    if(csv) {
+        writeCSV(frame, millis);
+    }
+    return 1;
+}
+
+int gtEndFrame() {
+    if(!enabled) {
+        return 0;
+    }
+    frames[current].number = frameNumber++;
+    current = (current + 1) % GT_FRAMES;
+
+    // The frame about to be reused is the oldest one in flight.
+    TimerFrame *oldest = &frames[current];
+    int gotResults     = frameNumber > GT_FRAMES ? readFrame(oldest) : 0;
+    memset(oldest->used, 0, sizeof(oldest->used));
+    return gotResults;
+}
+
+int gtScopeCount() {
+    return numScopes;
+}
+
+const char *gtScopeName(int scope) {
+    return scopes[scope].name;
+}
+
+float gtLastMillis(int scope) {
+    return scopes[scope].last;
+}
+
+float gtAverageMillis(int scope) {
+    TimerScope *s = &scopes[scope];
+    if(!s->results) {
+        return -1;
+    }
+    unsigned count = s->results < GT_HISTORY ? s->results : GT_HISTORY;
+    return s->sum / count;
+}
+
+int gtOpenCSV(const char *filename) {
+    csv = fopen(filename, "w");
+    if(!csv) {
+        fprintf(stderr, "can't open %s for writing\n", filename);
+        return 0;
+    }
+    return 1;
+}
+
+void gtShutdown() {
+    if(csv) {
+        fclose(csv);
+        csv = NULL;
+    }
+    if(dropped) {
+        printf("GPU timer: %u frames dropped while waiting for results\n",
+               dropped);
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef CUBES_GPUTIMER_H
+#define CUBES_GPUTIMER_H
+
+// GPU time spent in named parts of a frame, measured with timestamp
+// queries. The GPU runs behind the CPU, so each frame's queries are only
+// read back GT_FRAMES frames later, when they're done; waiting for them
+// any earlier would stall the CPU. Scopes may nest or overlap.
+
+enum { GT_FRAMES = 4 };      // frames of queries in flight
+enum { GT_MAX_SCOPES = 16 }; // named scopes
+enum { GT_HISTORY = 64 };    // frames averaged by gtAverageMillis()
+
+// create the query pool; return 0 if the GL has no usable timer
+int gtInit();
+// register a named scope; return its index, or -1 if out of scopes
+int gtScope(const char *name);
+// mark the start and end of a scope; each may be timed once per frame
+void gtBegin(int scope);
+void gtEnd(int scope);
+// finish the frame and read back the oldest one in flight if it's done;
+// return 1 if new results came in
+int gtEndFrame();
+// get the number of scopes and their names
+int gtScopeCount();
+const char *gtScopeName(int scope);
+// get a scope's latest result, or -1 if it has none
+float gtLastMillis(int scope);
+// get the average of a scope's last GT_HISTORY results
+float gtAverageMillis(int scope);
+// write every frame's results to a CSV file as they come in
+int gtOpenCSV(const char *filename);
+// close the CSV file
+void gtShutdown();
+
+#endif
@@ -0,0 +1,111 @@
+/**
+ * headless.c
+ * Windowless GL contexts.
+ *
+ * SDL2 can't make a GL context without a window, so this talks to EGL
+ * directly. The pbuffer surface gives the context a default framebuffer of
+ * the requested size, so the demo renders to it just like to a window and
+ * the frame can be read back from framebuffer 0.
+ */
+
+#include <stdio.h>
+#include "headless.h"
+
+#ifdef WINDOWS
+
+int hlCreateContext(int width, int height) {
+    (void)width;
+    (void)height;
+    fprintf(stderr, "error: headless rendering needs EGL\n");
+    return 0;
+}
+
+void hlDestroyContext() {
+}
+
+#else
+
+#include <EGL/egl.h>
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLSurface surface = EGL_NO_SURFACE;
+static EGLContext context = EGL_NO_CONTEXT;
+
+int hlCreateContext(int width, int height) {
+    EGLint major, minor;
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if(display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        fprintf(stderr, "error: can't initialize EGL\n");
+        return 0;
+    }
+    // Core profile contexts need EGL 1.5 or EGL_KHR_create_context, whose
+    // attribute names are the same.
+    if(major == 1 && minor < 5) {
+        fprintf(stderr, "warning: EGL %i.%i may not support GL 3.3 Core\n",
+                major, minor);
+    }
+    if(!eglBindAPI(EGL_OPENGL_API)) {
+        fprintf(stderr, "error: EGL doesn't support desktop GL\n");
+        return 0;
+    }
+
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8, EGL_DEPTH_SIZE, 24,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configs = 0;
+    if(!eglChooseConfig(display, configAttribs, &config, 1, &configs) ||
+       configs < 1) {
+        fprintf(stderr, "error: no EGL config for pbuffer rendering\n");
+        return 0;
+    }
+
+    const EGLint surfaceAttribs[] = {
+        EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE
+    };
+    surface = eglCreatePbufferSurface(display, config, surfaceAttribs);
+    if(surface == EGL_NO_SURFACE) {
+        fprintf(stderr, "error: can't create a %ix%i pbuffer\n", width,
+                height);
+        return 0;
+    }
+
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT,
+                               contextAttribs);
+    if(context == EGL_NO_CONTEXT ||
+       !eglMakeCurrent(display, surface, surface, context)) {
+        fprintf(stderr, "error: can't create a GL 3.3 Core context\n");
+        return 0;
+    }
+    printf("rendering headless with EGL %i.%i\n", major, minor);
+    return 1;
+}
+
+void hlDestroyContext() {
+    if(display == EGL_NO_DISPLAY) {
+        return;
+    }
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if(context != EGL_NO_CONTEXT) {
+        eglDestroyContext(display, context);
+    }
+    if(surface != EGL_NO_SURFACE) {
+        eglDestroySurface(display, surface);
+    }
+    eglTerminate(display);
+    display = EGL_NO_DISPLAY;
+    surface = EGL_NO_SURFACE;
+    context = EGL_NO_CONTEXT;
+}
+
+#endif
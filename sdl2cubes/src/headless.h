@@ -0,0 +1,15 @@
+#ifndef CUBES_HEADLESS_H
+#define CUBES_HEADLESS_H
+
+// An OpenGL 3.3 Core context without a window, for rendering on machines
+// with no display or GPU. It's created with EGL on an offscreen pbuffer
+// surface, which Mesa's software rasterizer (llvmpipe) supports. With no
+// display server at all, run with EGL_PLATFORM=surfaceless.
+
+// create a context whose default framebuffer is width x height and make it
+// current; return 0 on failure
+int hlCreateContext(int width, int height);
+// release the context
+void hlDestroyContext();
+
+#endif
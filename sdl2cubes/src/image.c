@@ -3,18 +3,22 @@
 #include <stb_image.h>
 #define GLEW_STATIC
 #include <GL/glew.h>
+#include "dsa.h"
+#include "trace.h"
 
 unsigned loadImageToTexture(const char *filename) {
     GLuint tex = 0;
     GLenum format, internalFormat;
     int width = 0, height = 0, components = 0;
 
+    TRACE_BEGIN("loadImageToTexture");
     // This can load many image formats, including PNG and JPEG.
     unsigned char *image =
         stbi_load(filename, &width, &height, &components, 0);
 
     if(!image) {
         fprintf(stderr, "error: can't open image: %s\n", filename);
+        TRACE_END();
         return 0;
     }
 
@@ -23,30 +27,31 @@ unsigned loadImageToTexture(const char *filename) {
     // We could pass nonzero components to stbi_load to request a specific
     // pixel format if we really wanted to.
     if(components == 4) {
-        internalFormat = format = GL_RGBA;
+        internalFormat = GL_RGBA8;
+        format         = GL_RGBA;
     } else if(components == 3) {
-        internalFormat = format = GL_RGB;
+        internalFormat = GL_RGB8;
+        format         = GL_RGB;
     } else {
         fprintf(stderr, "error: unsupported pixel format: %s\n", filename);
         goto exit;
     }
 
-    glGenTextures(1, &tex);
-    // let's at least be consistent about which slot gets side effects
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, tex);
-    // allocate and initialize the texture with our image data
-    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format,
-                 GL_UNSIGNED_BYTE, image);
+    tex = dsaCreateTexture2D();
+    // allocate storage for one level and fill it with our image data
+    dsaTextureStorage2D(tex, 1, internalFormat, width, height);
+    dsaTextureSubImage2D(tex, 0, 0, 0, width, height, format,
+                         GL_UNSIGNED_BYTE, image);
 
     // GL_TEXTURE_MIN_FILTER is set to use mipmaps by default.
-    // Unless they're provided or generated, the texture is incomplete
-    // and can't be used. If we need mipmaps, call glGenerateMipmaps first
-    // and set this to GL_LINEAR_MIPMAP_LINEAR instead.
+    // The storage only has one level, so sampling it that way would skip
+    // the filtering between levels. If we need mipmaps, allocate more
+    // levels, generate them and set this to GL_LINEAR_MIPMAP_LINEAR.
     // https://www.opengl.org/sdk/docs/man/html/glTexParameter.xhtml
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    dsaTextureParameteri(tex, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 
 exit:
     stbi_image_free(image);
+    TRACE_END();
     return tex;
 }
@@ -0,0 +1,124 @@
+/**
+ * jobs.c
+ * Minimal thread pool for splitting loops across cores.
+ *
+ * The worker threads sleep on a semaphore until jobsParallelFor() hands
+ * them a loop. Everyone, including the calling thread, then grabs chunks
+ * of it off an atomic counter until none are left. Any thread may start a
+ * loop, but only one runs at a time; loops started meanwhile from other
+ * threads wait for their turn.
+ */
+
+#include <SDL2/SDL.h>
+#include <assert.h>
+#include "jobs.h"
+#include "trace.h"
+
+typedef struct JobLoop {
+    JobFunc func;
+    void *data;
+    unsigned count;
+    unsigned chunks;
+    SDL_atomic_t next; // next chunk to run
+} JobLoop;
+
+static SDL_Thread *threads[JOBS_MAX_THREADS];
+static unsigned numThreads = 1;
+static SDL_sem *startSem   = NULL; // posted once per worker per loop
+static SDL_sem *doneSem    = NULL; // posted by each worker when done
+static SDL_mutex *loopLock = NULL; // held while a loop runs
+static JobLoop currentLoop;
+static int quitting = 0;
+
+static void runChunks(JobLoop *loop) {
+    for(;;) {
+        unsigned chunk = (unsigned)SDL_AtomicAdd(&loop->next, 1);
+        if(chunk >= loop->chunks) {
+            break;
+        }
+        unsigned first = (unsigned)((unsigned long long)loop->count * chunk /
+                                    loop->chunks);
+        unsigned end   = (unsigned)((unsigned long long)loop->count *
+                                  (chunk + 1) / loop->chunks);
+        if(end > first) {
+            TRACE_BEGIN("job chunk");
+            loop->func(loop->data, first, end - first, chunk);
+            TRACE_END();
+        }
+    }
+}
+
+static int workerMain(void *arg) {
+    (void)arg;
+    TRACE_THREAD("worker");
+    for(;;) {
+        // The semaphores also make sure the loop's setup is visible here
+        // and the results are visible to the caller.
+        SDL_SemWait(startSem);
+        if(quitting) {
+            break;
+        }
+        runChunks(&currentLoop);
+        SDL_SemPost(doneSem);
+    }
+    return 0;
+}
+
+void jobsInit(unsigned count) {
+    if(count < 1) {
+        count = 1;
+    } else if(count > JOBS_MAX_THREADS) {
+        count = JOBS_MAX_THREADS;
+    }
+    startSem   = SDL_CreateSemaphore(0);
+    doneSem    = SDL_CreateSemaphore(0);
+    loopLock   = SDL_CreateMutex();
+    numThreads = 1;
+    for(unsigned i = 1; i < count; i++) {
+        threads[i] = SDL_CreateThread(workerMain, "worker", NULL);
+        if(!threads[i]) {
+            break;
+        }
+        numThreads++;
+    }
+}
+
+void jobsShutdown() {
+    quitting = 1;
+    for(unsigned i = 1; i < numThreads; i++) {
+        SDL_SemPost(startSem);
+    }
+    for(unsigned i = 1; i < numThreads; i++) {
+        SDL_WaitThread(threads[i], NULL);
+    }
+    SDL_DestroySemaphore(startSem);
+    SDL_DestroySemaphore(doneSem);
+    SDL_DestroyMutex(loopLock);
+    numThreads = 1;
+    quitting   = 0;
+}
+
+unsigned jobsThreadCount() {
+    return numThreads;
+}
+
+void jobsParallelFor(JobFunc func, void *data, unsigned count,
+                     unsigned chunks) {
+    assert(chunks > 0);
+    SDL_LockMutex(loopLock);
+    currentLoop.func   = func;
+    currentLoop.data   = data;
+    currentLoop.count  = count;
+    currentLoop.chunks = chunks;
+    SDL_AtomicSet(&currentLoop.next, 0);
+    // Not worth waking anyone up for a single chunk.
+    unsigned helpers = chunks > 1 ? numThreads - 1 : 0;
+    for(unsigned i = 0; i < helpers; i++) {
+        SDL_SemPost(startSem);
+    }
+    runChunks(&currentLoop);
+    for(unsigned i = 0; i < helpers; i++) {
+        SDL_SemWait(doneSem);
+    }
+    SDL_UnlockMutex(loopLock);
+}
@@ -0,0 +1,25 @@
+#ifndef CUBES_JOBS_H
+#define CUBES_JOBS_H
+
+// Work done for the items [first, first + count) of a parallel loop.
+// chunk tells which part of the loop this is, so results can be kept in
+// per-chunk storage and merged in a deterministic order afterwards.
+typedef void (*JobFunc)(void *data, unsigned first, unsigned count,
+                        unsigned chunk);
+
+enum { JOBS_MAX_THREADS = 32 };
+
+// start worker threads so that count threads work on loops, including the
+// calling thread; 1 means everything runs on the caller
+void jobsInit(unsigned count);
+// stop and join the worker threads
+void jobsShutdown();
+// get the number of threads work is split across
+unsigned jobsThreadCount();
+// split count items into chunks, run them on all threads and wait for them
+// all to finish; chunk k always covers the same items for the same count;
+// loops from different threads run one after another
+void jobsParallelFor(JobFunc func, void *data, unsigned count,
+                     unsigned chunks);
+
+#endif
@@ -16,10 +16,23 @@
 #include "audio.h"
 #include "shaders.h"
 #include "mesh_obj.h"
+#include "ringbuffer.h"
+#include "jobs.h"
+#include "dsa.h"
+#include "glstate.h"
+#include "gputimer.h"
+#include "trace.h"
+#include "headless.h"
+#include "framecapture.h"
+#include "framelimiter.h"
+#include "rtpool.h"
+#include "benchmark.h"
 
 #define CUBES_DEBUG 0
 
 extern int runDemo(float dt);
+extern void updateDemo(int packet, float dt);
+extern int renderDemo(int packet);
 extern int initDemo();
 extern void resizeDemo();
 extern const char *WINDOW_TITLE;
@@ -31,10 +44,33 @@ int g_windowWidth       = 1280;
 int g_windowHeight      = 720;
 float g_aspect          = 16.0f / 9.0f;
 int g_paused            = 0;
+int g_showOverlay       = 1; // draw performance numbers over the frame
+int g_showGraph         = 0; // draw frame timing graphs over the frame
 unsigned g_mouseButtons = 0;
 float g_fps             = 0;
-
-Uint32 g_ticks, g_lastTicks;
+int g_instancing        = 1; // draw repeated meshes with instanced calls
+int g_multiDraw         = 1; // use multi-draw indirect where available
+int g_directStateAccess = 1; // edit GL objects without binding them
+int g_uploadStrategy    = UPLOAD_AUTO; // how to stream uniform data
+int g_threads           = 0;  // threads for scene traversal, 0 = all cores
+unsigned g_sceneObjects = 20; // number of objects in the scene
+int g_gpuAnimation      = 0;  // animate the scene in the vertex shader
+unsigned g_particles    = 0;  // GPU particles, 0 = none
+unsigned g_cpuParticles = 0;  // CPU-simulated particles, 0 = none
+int g_poisonArenas      = 0;  // overwrite freed arena memory
+int g_headless          = 0;  // render frames to files without a window
+int g_vsync             = 1;  // swap interval: 1 on, 0 off, -1 adaptive
+float g_maxFPS          = 0;  // frame rate cap, 0 = none
+int g_pipelined         = 0;  // run the demo logic on its own thread
+int g_benchmark         = 0;  // fly a fixed camera path and measure frames
+float g_fixedDt         = 0;  // seconds to step each frame, 0 = real time
+float g_gpuBudget       = 0;  // GPU ms per frame to scale resolution for
+const char *g_sceneMeshFiles[MAX_SCENE_MESHES]; // meshes for the objects
+unsigned g_numSceneMeshFiles = 0;
+
+Uint64 g_ticks, g_lastTicks; // performance counter at frame starts
+FrameTimes g_frameTimes;
+FrameTimeStats g_frameStats; // refreshed every second
 int g_glUniformAlignment = 0;
 
 typedef struct AudioState { AudioReader *reader; } AudioState;
@@ -45,9 +81,19 @@ SDL_AudioDeviceID g_audioDevice;
 
 void playAudio(const char *filename);
 void generateAudio(void *userdata, Uint8 *stream, int len);
+int createWindow(int fullscreen);
+void renderOffline(const char *pattern, unsigned frames, float fps,
+                   const char *wavFile);
 void presentWindow();
 void handleWindowResize(int width, int height);
-void trackPerformance(unsigned deltaMillis);
+void trackPerformance(double frameMillis);
+void printPacing(int reset);
+void handleLogicEvent(const SDL_Event *event);
+void forwardEvent(const SDL_Event *event);
+void startPipeline();
+int renderPipelined(unsigned frame);
+void stopPipeline();
+void writeBenchmarkReport(const char *filename, const Benchmark *bm);
 
 #if defined(__GNUC__)
 #define UNUSED(x) x __attribute__((unused))
@@ -78,53 +124,152 @@ void
  */
 int main(int argc, char *argv[]) {
     SDL_Event event;
-    int running    = 1;
-    int fullscreen = 0;
-
+    int running        = 1;
+    int fullscreen     = 0;
+    const char *gpuCSV = NULL; // file to write GPU times to
+    // offline rendering
+    const char *renderPattern = NULL; // frame file names
+    const char *renderWAV     = NULL; // soundtrack file name
+    unsigned renderFrames     = 600;
+    float renderFPS           = 60;
+    const char *benchmarkFile = NULL; // benchmark report, "-" for stdout
+
+    TRACE_INIT();
+    TRACE_THREAD("main");
     for(int i = 0; i < argc; i++) {
         if(strcmp(argv[i], "--fullscreen") == 0) {
             fullscreen = 1;
+        } else if(strcmp(argv[i], "--no-instancing") == 0) {
+            g_instancing = 0;
+        } else if(strcmp(argv[i], "--no-multidraw") == 0) {
+            g_multiDraw = 0;
+        } else if(strcmp(argv[i], "--no-dsa") == 0) {
+            g_directStateAccess = 0;
+        } else if(strcmp(argv[i], "--upload-strategy") == 0 && i + 1 < argc) {
+            g_uploadStrategy = ringStrategyFromName(argv[++i]);
+            if(g_uploadStrategy == UPLOAD_AUTO &&
+               strcmp(argv[i], "auto") != 0) {
+                fprintf(stderr, "unknown upload strategy %s\n", argv[i]);
+            }
+        } else if(strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            g_threads = atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--objects") == 0 && i + 1 < argc) {
+            g_sceneObjects = (unsigned)atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--gpu-animation") == 0) {
+            g_gpuAnimation = 1;
+        } else if(strcmp(argv[i], "--particles") == 0 && i + 1 < argc) {
+            g_particles = (unsigned)atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--cpu-particles") == 0 && i + 1 < argc) {
+            g_cpuParticles = (unsigned)atoi(argv[++i]);
+        } else if(strcmp(argv[i], "--debug-gl-state") == 0) {
+            gsSetDebug(1);
+        } else if(strcmp(argv[i], "--gpu-csv") == 0 && i + 1 < argc) {
+            gpuCSV = argv[++i];
+        } else if(strcmp(argv[i], "--poison-arenas") == 0) {
+            g_poisonArenas = 1;
+        } else if(strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            if(sscanf(argv[++i], "%ix%i", &g_windowWidth,
+                      &g_windowHeight) != 2 ||
+               g_windowWidth < 1 || g_windowHeight < 1) {
+                fprintf(stderr, "--size needs WIDTHxHEIGHT\n");
+                return 1;
+            }
+            g_aspect = (float)g_windowWidth / g_windowHeight;
+        } else if(strcmp(argv[i], "--render") == 0 && i + 1 < argc) {
+            renderPattern = argv[++i];
+            g_headless    = 1;
+            g_showOverlay = 0;
+        } else if(strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            int frames   = atoi(argv[++i]);
+            renderFrames = frames > 0 ? (unsigned)frames : 0;
+        } else if(strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            renderFPS = (float)atof(argv[++i]);
+            if(renderFPS <= 0) {
+                renderFPS = 60;
+            }
+        } else if(strcmp(argv[i], "--wav") == 0 && i + 1 < argc) {
+            renderWAV = argv[++i];
+        } else if(strcmp(argv[i], "--vsync") == 0 && i + 1 < argc) {
+            i++;
+            if(strcmp(argv[i], "on") == 0) {
+                g_vsync = 1;
+            } else if(strcmp(argv[i], "off") == 0) {
+                g_vsync = 0;
+            } else if(strcmp(argv[i], "adaptive") == 0) {
+                g_vsync = -1;
+            } else {
+                fprintf(stderr, "--vsync needs on, off or adaptive\n");
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--max-fps") == 0 && i + 1 < argc) {
+            g_maxFPS = (float)atof(argv[++i]);
+            if(g_maxFPS < 0) {
+                fprintf(stderr, "--max-fps needs a rate, or 0 for none\n");
+                return 1;
+            }
+        } else if(strcmp(argv[i], "--pipeline") == 0) {
+            g_pipelined = 1;
+        } else if(strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc) {
+            benchmarkFile = argv[++i];
+            g_benchmark   = 1;
+        } else if(strcmp(argv[i], "--gpu-budget") == 0 && i + 1 < argc) {
+            g_gpuBudget = (float)atof(argv[++i]);
+        } else if(strcmp(argv[i], "--mesh") == 0 && i + 1 < argc) {
+            if(g_numSceneMeshFiles < MAX_SCENE_MESHES) {
+                g_sceneMeshFiles[g_numSceneMeshFiles++] = argv[++i];
+            } else {
+                fprintf(stderr, "at most %d meshes, ignoring %s\n",
+                        MAX_SCENE_MESHES, argv[++i]);
+            }
         }
     }
-    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
-
-    // https://wiki.libsdl.org/SDL_CreateWindow
-    int flags = SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE;
-    if(fullscreen) {
-        flags |= SDL_WINDOW_FULLSCREEN;
+    // Rendering to files has no frame times worth reporting.
+    if(g_benchmark && g_headless) {
+        fprintf(stderr, "--benchmark can't be combined with --render\n");
+        return 1;
     }
-    g_sdlWindow =
-        SDL_CreateWindow("", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-                         g_windowWidth, g_windowHeight, flags);
-
-    if(!g_sdlWindow) {
-        fprintf(stderr, "CreateWindow failed! Is the resolution supported?\n");
+    if(g_benchmark && renderFrames < 1) {
+        fprintf(stderr, "--benchmark needs at least one frame to measure\n");
         return 1;
     }
+    // A benchmark steps time by fixed amounts, so the same frames are drawn
+    // on every run, and draws them as fast as it can.
+    if(g_benchmark) {
+        g_fixedDt     = 1.0f / renderFPS;
+        g_vsync       = 0;
+        g_maxFPS      = 0;
+        g_showOverlay = 0;
+    }
+    SDL_Init(g_headless ? SDL_INIT_TIMER : SDL_INIT_VIDEO | SDL_INIT_AUDIO);
 
-    setWindowTitle("loading...");
-
-    // Set up an OpenGL context for the window.
-    // OpenGL 3.3 Core is available on just about everything,
-    // including Windows, free Linux drivers and OS X.
-    // Recent mobile hardware is probably compatible with it, but
-    // the drivers may not be quite there.
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK,
-                        SDL_GL_CONTEXT_PROFILE_CORE);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
-    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+    // The main thread works too, so it counts as one of the threads.
+    int threads = g_threads > 0 ? g_threads : SDL_GetCPUCount();
+    jobsInit((unsigned)threads);
+    printf("using %u threads\n", jobsThreadCount());
 
-    if(!SDL_GL_CreateContext(g_sdlWindow)) {
-        fprintf(stderr, "GL_CreateContext failed!\n");
+    setWindowTitle("loading...");
+    if(g_headless) {
+        if(!hlCreateContext(g_windowWidth, g_windowHeight)) {
+            return 1;
+        }
+    } else if(!createWindow(fullscreen)) {
         return 1;
     }
+    // glewInit() also loads the window system's extensions, which fails
+    // without a window, so headless contexts only load the GL ones.
     glewExperimental = 1; // needed for extension fetching in core contexts
-    if(glewInit() != GLEW_OK) {
+    if((g_headless ? glewContextInit() : glewInit()) != GLEW_OK) {
         fprintf(stderr, "glewInit failed!\n");
         return 1;
     }
     // We'll need this when passing data to shaders.
     glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &g_glUniformAlignment);
+    // Everything after this changes GL state through the state cache.
+    gsInit();
+    dsaInit(g_directStateAccess);
+    if(gtInit() && gpuCSV) {
+        gtOpenCSV(gpuCSV);
+    }
 
 #if 0
     // ARB_debug_output can be used to log GL errors asynchronously.
@@ -150,7 +295,8 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     // If the demo loaded a soundtrack, set up SDL to accept its audio data.
-    if(g_audioState.reader) {
+    // Headless, it's written to a file instead, and benchmarks go without.
+    if(g_audioState.reader && !g_headless && !g_fixedDt) {
         // https://wiki.libsdl.org/CategoryAudio
         SDL_AudioSpec requested, got;
         requested.freq     = arGetRate(g_audioState.reader);
@@ -164,13 +310,34 @@ int main(int argc, char *argv[]) {
         // start playing sound
         SDL_PauseAudioDevice(g_audioDevice, 0);
     }
+    if(g_headless) {
+        renderOffline(renderPattern, renderFrames, renderFPS, renderWAV);
+        running = 0;
+    }
     // Enter the event loop. This polls and handles window events and runs
     // the demo for one frame when done.
-    g_lastTicks           = SDL_GetTicks();
+    g_lastTicks           = SDL_GetPerformanceCounter();
     unsigned frameCounter = 0;
+    ftInit(&g_frameTimes);
+    flInit(g_maxFPS);
+    Benchmark bm;
+    if(g_fixedDt) {
+        bmInit(&bm, renderFrames);
+        printf("benchmarking %u frames after %d warmup frames\n",
+               renderFrames, BM_WARMUP_FRAMES);
+    }
+    if(g_pipelined) {
+        startPipeline();
+    }
     while(running) {
         // https://wiki.libsdl.org/CategoryEvents
         while(SDL_PollEvent(&event)) {
+            // The demo logic gets its share of the events first.
+            if(g_pipelined) {
+                forwardEvent(&event);
+            } else {
+                handleLogicEvent(&event);
+            }
             switch(event.type) {
             case SDL_WINDOWEVENT: {
                 SDL_WindowEvent ev = event.window;
@@ -184,21 +351,15 @@ int main(int argc, char *argv[]) {
                     running = 0;
                 } else if(event.key.keysym.sym == SDLK_F5) {
                     reloadShaders();
-                } else if(event.key.keysym.sym == SDLK_p) {
-                    g_paused = !g_paused;
+                } else if(event.key.keysym.sym == SDLK_o) {
+                    g_showOverlay = !g_showOverlay;
+                } else if(event.key.keysym.sym == SDLK_g) {
+                    g_showGraph = !g_showGraph;
+                } else if(event.key.keysym.sym == SDLK_F12) {
+                    TRACE_WRITE("trace.json");
                 }
                 break;
             }
-            case SDL_MOUSEMOTION: {
-                // SDL_MouseMotionEvent ev = event.motion;
-                // relative mouse input is ev.xrel and ev.yrel
-                break;
-            }
-            case SDL_MOUSEWHEEL: {
-                // SDL_MouseWheelEvent ev = event.wheel;
-                // wheel motion is ev.y
-                break;
-            }
             case SDL_MOUSEBUTTONUP:
             case SDL_MOUSEBUTTONDOWN: {
                 SDL_MouseButtonEvent ev = event.button;
@@ -223,51 +384,265 @@ int main(int argc, char *argv[]) {
             }
         }
 
-        g_ticks              = SDL_GetTicks();
-        unsigned deltaMillis = g_ticks - g_lastTicks;
-        float dt             = deltaMillis * 0.001f;
-        g_lastTicks          = g_ticks;
-
-        trackPerformance(deltaMillis);
+        // SDL_GetTicks() only counts whole milliseconds, which is a big
+        // part of a frame at high refresh rates.
+        g_ticks            = SDL_GetPerformanceCounter();
+        double frameMillis = (g_ticks - g_lastTicks) * 1000.0 /
+                             SDL_GetPerformanceFrequency();
+        float dt           = g_fixedDt ? g_fixedDt
+                                       : (float)(frameMillis * 0.001);
+        g_lastTicks        = g_ticks;
+
+        trackPerformance(frameMillis);
+        // The counters still hold the previous frame's numbers, which is
+        // the frame that just took frameMillis.
+        if(g_fixedDt && bmAddFrame(&bm, (float)frameMillis, g_drawCalls,
+                                   g_uploadBytes)) {
+            break;
+        }
 
         // run demo, check if we're done yet
-        running &= runDemo(dt);
+        if(g_pipelined) {
+            running &= renderPipelined(frameCounter);
+        } else {
+            running &= runDemo(dt);
+        }
+        gsEndFrame();
         frameCounter++;
+        // sleep off the rest of the frame if it's capped
+        flWait();
+    }
+    if(g_pipelined) {
+        stopPipeline();
+    }
+    if(flEnabled()) {
+        printPacing(0);
+    }
+    if(g_fixedDt) {
+        writeBenchmarkReport(benchmarkFile, &bm);
+        bmFree(&bm);
     }
 
     SDL_CloseAudioDevice(g_audioDevice);
-    SDL_DestroyWindow(g_sdlWindow);
+    jobsShutdown();
+    gtShutdown();
+    TRACE_WRITE("trace.json");
+    if(g_headless) {
+        hlDestroyContext();
+    } else {
+        SDL_DestroyWindow(g_sdlWindow);
+    }
     SDL_Quit();
 
     return 0;
 }
 
-enum { NUM_FRAMEDELTAS = 32 };
-
-unsigned frameDeltas[NUM_FRAMEDELTAS] = {0};
+// The title is updated every second and frame times are logged every
+// LOG_INTERVAL updates.
+enum { LOG_INTERVAL = 10 };
 
-unsigned sumFrameDeltas     = 0;
-unsigned fdIndex            = 0;
-unsigned titleUpdateCounter = 0;
+double titleMillis    = 0;
+unsigned titleFrames  = 0;
+unsigned titleUpdates = 0;
 
 /**
- * Track framerates and update the window title.
+ * Track frame times and update the window title.
  */
-void trackPerformance(unsigned deltaMillis) {
-    sumFrameDeltas -= frameDeltas[fdIndex];
-    frameDeltas[fdIndex] = deltaMillis;
-    sumFrameDeltas += deltaMillis;
-    fdIndex = (fdIndex + 1) % NUM_FRAMEDELTAS;
-
-    titleUpdateCounter += deltaMillis;
-    if(titleUpdateCounter > 1000) {
-        titleUpdateCounter = titleUpdateCounter % 1000;
-        float fps          = 1000.0f * NUM_FRAMEDELTAS / sumFrameDeltas;
+void trackPerformance(double frameMillis) {
+    ftAdd(&g_frameTimes, (float)frameMillis);
+
+    titleMillis += frameMillis;
+    titleFrames++;
+    if(titleMillis > 1000) {
+        g_fps        = (float)(1000.0 * titleFrames / titleMillis);
+        g_frameStats = ftGetStats(&g_frameTimes);
+        titleMillis  = 0;
+        titleFrames  = 0;
+
         char tmp[256];
         const char *title = g_windowTitle ? g_windowTitle : "";
-        snprintf(tmp, sizeof(tmp), "%s (%.1f FPS)", title, fps);
+        GLStateStats gs = gsGetStats();
+        snprintf(tmp, sizeof(tmp),
+                 "%s (%.1f FPS, p99 %.1f ms, %u draws, %.1f KiB/frame, "
+                 "%u state calls, %u skipped)",
+                 title, g_fps, g_frameStats.p99, g_drawCalls,
+                 g_uploadBytes / 1024.0f, gs.issued, gs.skipped);
         SDL_SetWindowTitle(g_sdlWindow, tmp);
+
+        if(++titleUpdates % LOG_INTERVAL == 0) {
+            FrameTimeStats *s = &g_frameStats;
+            printf("last %u frames: mean %.2f, p50 %.2f, p95 %.2f, "
+                   "p99 %.2f, max %.2f ms, %u stutters (%u in total)\n",
+                   s->frames, s->mean, s->p50, s->p95, s->p99, s->max,
+                   s->stutters, s->totalStutters);
+            printf("average GPU times:");
+            for(int i = 0; i < gtScopeCount(); i++) {
+                float millis = gtAverageMillis(i);
+                if(millis >= 0) {
+                    printf(" %s %.2f ms", gtScopeName(i), millis);
+                }
+            }
+            printf("\n");
+            if(g_gpuBudget > 0) {
+                printf("render scale %.0f%% (%dx%d)\n", 100 * g_renderScale,
+                       (int)(g_windowWidth * g_renderScale + 0.5f),
+                       (int)(g_windowHeight * g_renderScale + 0.5f));
+            }
+            RenderTargetStats rt = rtGetStats();
+            printf("render targets: %u live (%.1f MiB), %u allocated, "
+                   "%u freed, %u reused\n",
+                   rt.live, rt.bytes / (1 << 20), rt.allocations, rt.frees,
+                   rt.reuses);
+            if(flEnabled()) {
+                printPacing(1);
+            }
+        }
+    }
+}
+
+/**
+ * Print how close to their deadlines the frame limiter woke up.
+ */
+void printPacing(int reset) {
+    PacingStats s = flGetStats(reset);
+    printf("frame pacing: %u waits, %.1f%% within %.1f ms, mean error "
+           "%.3f ms, max %.3f ms, %.0f%% asleep, %u late frames\n",
+           s.frames, s.frames ? 100.0f * s.onTime / s.frames : 0.0f,
+           FL_TOLERANCE_MS, s.meanError, s.maxError, 100 * s.sleepShare,
+           s.late);
+}
+
+// Write a string as a JSON string literal.
+void writeJSONString(FILE *file, const char *str) {
+    fputc('"', file);
+    for(; str && *str; str++) {
+        unsigned char c = (unsigned char)*str;
+        if(c == '"' || c == '\\') {
+            fprintf(file, "\\%c", c);
+        } else if(c < 0x20) {
+            fprintf(file, "\\u%04x", c);
+        } else {
+            fputc(c, file);
+        }
+    }
+    fputc('"', file);
+}
+
+/**
+ * Write the results of a benchmark and what was benchmarked as JSON.
+ */
+void writeBenchmarkReport(const char *filename, const Benchmark *bm) {
+    int toStdout = strcmp(filename, "-") == 0;
+    FILE *file   = toStdout ? stdout : fopen(filename, "w");
+    if(!file) {
+        fprintf(stderr, "can't write the benchmark report to %s\n",
+                filename);
+        return;
+    }
+    BenchmarkStats s = bmGetStats(bm);
+    fprintf(file, "{\n  \"renderer\": ");
+    writeJSONString(file, (const char *)glGetString(GL_RENDERER));
+    fprintf(file, ",\n  \"objects\": %u,\n  \"meshes\": [", g_sceneObjects);
+    if(!g_numSceneMeshFiles) {
+        writeJSONString(file, "res/unitcube.obj");
+    }
+    for(unsigned i = 0; i < g_numSceneMeshFiles; i++) {
+        fputs(i ? ", " : "", file);
+        writeJSONString(file, g_sceneMeshFiles[i]);
+    }
+    fprintf(file, "],\n  \"upload_strategy\": ");
+    writeJSONString(file, ringStrategyName((UploadStrategy)g_uploadStrategy));
+    fprintf(file,
+            ",\n  \"threads\": %u,\n  \"instancing\": %d,\n"
+            "  \"multi_draw\": %d,\n  \"direct_state_access\": %d,\n"
+            "  \"pipeline\": %d,\n  \"gpu_animation\": %d,\n"
+            "  \"particles\": %u,\n  \"cpu_particles\": %u,\n"
+            "  \"width\": %d,\n  \"height\": %d,\n"
+            "  \"gpu_budget_ms\": %.2f,\n  \"render_scale\": %.4f,\n"
+            "  \"render_target_allocations\": %u,\n",
+            jobsThreadCount(), g_instancing, g_multiDraw, dsaEnabled(),
+            g_pipelined, g_gpuAnimation, g_particles, g_cpuParticles,
+            g_windowWidth, g_windowHeight, g_gpuBudget, g_renderScale,
+            rtGetStats().allocations);
+    fprintf(file,
+            "  \"warmup_frames\": %d,\n  \"frames\": %u,\n"
+            "  \"seconds\": %.3f,\n",
+            BM_WARMUP_FRAMES, s.frames, s.seconds);
+    fprintf(file,
+            "  \"frame_ms\": {\"mean\": %.3f, \"min\": %.3f, "
+            "\"p50\": %.3f, \"p90\": %.3f, \"p95\": %.3f, "
+            "\"p99\": %.3f, \"max\": %.3f},\n",
+            s.mean, s.min, s.p50, s.p90, s.p95, s.p99, s.max);
+    fprintf(file,
+            "  \"draw_calls\": {\"mean\": %.1f, \"max\": %u},\n"
+            "  \"upload_bytes\": {\"mean_per_frame\": %.0f, "
+            "\"total\": %.0f},\n"
+            "  \"peak_rss_bytes\": %zu\n}\n",
+            s.drawCalls, s.maxDrawCalls, s.uploadBytes, s.totalUploadBytes,
+            bmPeakRSS());
+    if(!toStdout) {
+        fclose(file);
+        printf("wrote the benchmark report to %s\n", filename);
+    }
+}
+
+// What the soundtrack writer thread needs.
+typedef struct SoundtrackJob {
+    AudioReader *reader;
+    const char *filename;
+    double seconds;
+} SoundtrackJob;
+
+int writeSoundtrack(void *data) {
+    TRACE_THREAD("soundtrack writer");
+    SoundtrackJob *job = (SoundtrackJob *)data;
+    return arWriteWAV(job->reader, job->filename, job->seconds);
+}
+
+/**
+ * Render frames to files as fast as they can be rendered, stepping the
+ * demo by exactly 1 / fps seconds per frame. The soundtrack is decoded to
+ * a WAV file of the same length at the same time.
+ */
+void renderOffline(const char *pattern, unsigned frames, float fps,
+                   const char *wavFile) {
+    if(!fcInit(g_windowWidth, g_windowHeight, pattern)) {
+        return;
     }
+    SoundtrackJob job = {g_audioState.reader, wavFile, frames / fps};
+    SDL_Thread *audioThread = NULL;
+    if(job.reader && job.filename) {
+        audioThread =
+            SDL_CreateThread(writeSoundtrack, "soundtrack writer", &job);
+    }
+
+    Uint64 frequency = SDL_GetPerformanceFrequency();
+    Uint64 start     = SDL_GetPerformanceCounter();
+    Uint64 reported  = start;
+    float dt         = 1.0f / fps;
+    unsigned frame   = 0;
+    g_fps            = fps;
+    while(frame < frames) {
+        int more = runDemo(dt);
+        gsEndFrame();
+        frame++;
+        if(!more) {
+            break;
+        }
+        Uint64 now = SDL_GetPerformanceCounter();
+        if(now - reported > frequency) {
+            printf("frame %u/%u\n", frame, frames);
+            reported = now;
+        }
+    }
+    fcFinish();
+    if(audioThread) {
+        SDL_WaitThread(audioThread, NULL);
+    }
+    double seconds = (double)(SDL_GetPerformanceCounter() - start) /
+                     frequency;
+    printf("rendered %u frames in %.1f s, %.1f frames/s\n", frame, seconds,
+           frame / seconds);
 }
 
 /**
@@ -295,19 +670,71 @@ void setWindowTitle(const char *title) {
  * @note This will be called from another thread.
  */
 void generateAudio(void *userdata, Uint8 *stream, int len) {
+    TRACE_THREAD("audio");
+    TRACE_BEGIN("generateAudio");
     AudioState *state = (AudioState *)userdata;
     int ofs           = arRead(state->reader, stream, len);
     // set any remaining buffer to 0
     if(len - ofs) {
         memset(stream + ofs, 0, len - ofs);
     }
+    TRACE_END();
+}
+
+/**
+ * Create the window and its GL context.
+ */
+int createWindow(int fullscreen) {
+    // https://wiki.libsdl.org/SDL_CreateWindow
+    int flags = SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE;
+    if(fullscreen) {
+        flags |= SDL_WINDOW_FULLSCREEN;
+    }
+    g_sdlWindow =
+        SDL_CreateWindow("", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                         g_windowWidth, g_windowHeight, flags);
+
+    if(!g_sdlWindow) {
+        fprintf(stderr, "CreateWindow failed! Is the resolution supported?\n");
+        return 0;
+    }
+
+    // Set up an OpenGL context for the window.
+    // OpenGL 3.3 Core is available on just about everything,
+    // including Windows, free Linux drivers and OS X.
+    // Recent mobile hardware is probably compatible with it, but
+    // the drivers may not be quite there.
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK,
+                        SDL_GL_CONTEXT_PROFILE_CORE);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+
+    if(!SDL_GL_CreateContext(g_sdlWindow)) {
+        fprintf(stderr, "GL_CreateContext failed!\n");
+        return 0;
+    }
+    // Adaptive vsync tears instead of waiting for the next refresh when a
+    // frame is late, but not every driver has it.
+    if(SDL_GL_SetSwapInterval(g_vsync) != 0) {
+        if(g_vsync == -1 && SDL_GL_SetSwapInterval(1) == 0) {
+            printf("warning: no adaptive vsync, using regular vsync\n");
+        } else {
+            printf("warning: can't set vsync: %s\n", SDL_GetError());
+        }
+    }
+    return 1;
 }
 
 /**
- * Present the GL context's backbuffer to the screen.
+ * Present the GL context's backbuffer to the screen. Headless, the frame
+ * is captured instead.
  */
 void presentWindow() {
-    SDL_GL_SwapWindow(g_sdlWindow);
+    if(g_headless) {
+        fcCapture();
+    } else {
+        SDL_GL_SwapWindow(g_sdlWindow);
+    }
 }
 
 /**
@@ -316,7 +743,142 @@ void presentWindow() {
 void handleWindowResize(int width, int height) {
     g_windowWidth  = width;
     g_windowHeight = height;
-    g_aspect = (float)width / height;
-    glViewport(0, 0, width, height);
+    gsViewport(0, 0, width, height);
     resizeDemo();
 }
+
+/**
+ * Handle the events the demo logic cares about. With --pipeline, this
+ * runs on the logic thread, so it must not touch GL or SDL's window.
+ */
+void handleLogicEvent(const SDL_Event *event) {
+    switch(event->type) {
+    case SDL_WINDOWEVENT: {
+        SDL_WindowEvent ev = event->window;
+        if(ev.event == SDL_WINDOWEVENT_RESIZED) {
+            g_aspect = (float)ev.data1 / ev.data2;
+        }
+        break;
+    }
+    case SDL_KEYDOWN: {
+        // Pausing would make the benchmark measure something else.
+        if(event->key.keysym.sym == SDLK_p && !g_benchmark) {
+            g_paused = !g_paused;
+        }
+        break;
+    }
+    case SDL_MOUSEMOTION: {
+        // SDL_MouseMotionEvent ev = event->motion;
+        // relative mouse input is ev.xrel and ev.yrel
+        break;
+    }
+    case SDL_MOUSEWHEEL: {
+        // SDL_MouseWheelEvent ev = event->wheel;
+        // wheel motion is ev.y
+        break;
+    }
+    default:; // not interesting enough.
+    }
+}
+
+// ---- pipelined frames ----
+
+// With --pipeline, a logic thread runs updateDemo() for the next frame
+// while the main thread, which owns the GL context, runs renderDemo() for
+// the current one. They pass the demo's FRAME_PACKETS frame packets back
+// and forth with two semaphores, so the logic can get one frame ahead and
+// a frame takes about as long as the slower of the two instead of both.
+// SDL only delivers events on the main thread, so the ones the logic
+// needs are forwarded through a locked queue.
+
+enum { FORWARD_EVENTS = 256 }; // events waiting for the logic thread
+
+SDL_Thread *g_logicThread = NULL;
+SDL_sem *g_freePackets    = NULL; // packets the logic may fill
+SDL_sem *g_readyPackets   = NULL; // packets ready to render
+SDL_atomic_t g_logicQuit;         // set to stop the logic thread
+SDL_mutex *g_forwardLock  = NULL; // guards the forwarded events
+SDL_Event g_forwarded[FORWARD_EVENTS];
+unsigned g_forwardRead = 0, g_forwardWrite = 0; // positions in the ring
+
+/**
+ * Pass an event on to the logic thread.
+ */
+void forwardEvent(const SDL_Event *event) {
+    SDL_LockMutex(g_forwardLock);
+    // If the logic is this far behind, losing an event is the least of
+    // our problems.
+    if(g_forwardWrite - g_forwardRead < FORWARD_EVENTS) {
+        g_forwarded[g_forwardWrite++ % FORWARD_EVENTS] = *event;
+    }
+    SDL_UnlockMutex(g_forwardLock);
+}
+
+int logicMain(void *data) {
+    (void)data;
+    TRACE_THREAD("logic");
+    double frequency = (double)SDL_GetPerformanceFrequency();
+    Uint64 lastTicks = SDL_GetPerformanceCounter();
+    for(unsigned frame = 0;; frame++) {
+        SDL_SemWait(g_freePackets);
+        if(SDL_AtomicGet(&g_logicQuit)) {
+            break;
+        }
+        SDL_LockMutex(g_forwardLock);
+        while(g_forwardRead != g_forwardWrite) {
+            handleLogicEvent(&g_forwarded[g_forwardRead++ % FORWARD_EVENTS]);
+        }
+        SDL_UnlockMutex(g_forwardLock);
+
+        // The logic keeps its own time. Once the pipeline is full it runs
+        // at the render thread's pace anyway.
+        Uint64 ticks = SDL_GetPerformanceCounter();
+        float dt     = (float)((ticks - lastTicks) / frequency);
+        lastTicks    = ticks;
+        updateDemo(frame % FRAME_PACKETS, g_fixedDt ? g_fixedDt : dt);
+        SDL_SemPost(g_readyPackets);
+    }
+    return 0;
+}
+
+/**
+ * Start the logic thread. If that fails, frames are run serially.
+ */
+void startPipeline() {
+    g_freePackets  = SDL_CreateSemaphore(FRAME_PACKETS);
+    g_readyPackets = SDL_CreateSemaphore(0);
+    g_forwardLock  = SDL_CreateMutex();
+    SDL_AtomicSet(&g_logicQuit, 0);
+    g_logicThread = SDL_CreateThread(logicMain, "logic", NULL);
+    if(!g_logicThread) {
+        printf("warning: can't start the logic thread, not pipelining\n");
+        g_pipelined = 0;
+        return;
+    }
+    printf("running demo logic and rendering on separate threads\n");
+}
+
+/**
+ * Render the next frame the logic thread has finished, and hand the
+ * packet back to it.
+ */
+int renderPipelined(unsigned frame) {
+    TRACE_BEGIN("wait for logic");
+    SDL_SemWait(g_readyPackets);
+    TRACE_END();
+    int result = renderDemo(frame % FRAME_PACKETS);
+    SDL_SemPost(g_freePackets);
+    return result;
+}
+
+/**
+ * Stop the logic thread once it's done with the frame it's on.
+ */
+void stopPipeline() {
+    SDL_AtomicSet(&g_logicQuit, 1);
+    SDL_SemPost(g_freePackets);
+    SDL_WaitThread(g_logicThread, NULL);
+    SDL_DestroySemaphore(g_freePackets);
+    SDL_DestroySemaphore(g_readyPackets);
+    SDL_DestroyMutex(g_forwardLock);
+}
@@ -1,6 +1,8 @@
 #ifndef CUBES_MAIN_H
 #define CUBES_MAIN_H
 
+#include "framestats.h"
+
 extern float g_aspect;
 extern int g_windowWidth;
 extern int g_windowHeight;
@@ -9,6 +11,32 @@ extern float g_time;
 
 extern int g_glUniformAlignment;
 extern int g_paused;
+extern int g_showOverlay;
+extern int g_showGraph;
+extern float g_fps;
+extern FrameTimeStats g_frameStats;
+extern int g_instancing;
+extern int g_multiDraw;
+extern int g_uploadStrategy;
+extern unsigned g_sceneObjects;
+extern int g_gpuAnimation;
+extern unsigned g_particles;
+extern unsigned g_cpuParticles;
+extern int g_poisonArenas;
+extern int g_benchmark;
+extern float g_gpuBudget;
+extern float g_renderScale;
+
+// meshes the scene's objects take turns using, from --mesh
+enum { MAX_SCENE_MESHES = 8 };
+extern const char *g_sceneMeshFiles[MAX_SCENE_MESHES];
+extern unsigned g_numSceneMeshFiles;
+
+extern unsigned g_drawCalls;
+extern unsigned g_uploadBytes;
+
+// frames that can be in flight between demo logic and rendering
+enum { FRAME_PACKETS = 2 };
 
 void setSoundtrack(const char *file);
 void setWindowTitle(const char *title);
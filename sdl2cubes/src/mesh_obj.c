@@ -6,6 +6,7 @@
  */
 
 #include "mesh_obj.h"
+#include "trace.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -62,8 +63,10 @@ Mesh *meshReadOBJ(const char *filename) {
         fprintf(stderr, "error: unable to open OBJ file %s\n", filename);
         return NULL;
     }
+    TRACE_BEGIN("meshReadOBJ");
     Mesh *mesh = meshReadOBJInternal(file, filename);
     fclose(file);
+    TRACE_END();
     return mesh;
 }
 
@@ -266,6 +269,59 @@ void meshPackVertices(Mesh *mesh, float *buffer) {
     }
 }
 
+// Vertices that share position, texcoord and normal indices are the same
+// vertex, so they only have to be stored once. A small hash table of OBJ
+// index triples is used to find them.
+unsigned meshPackIndexed(Mesh *mesh, float *buffer, unsigned *indices) {
+    MeshStats *stats   = &mesh->stats;
+    unsigned *pIndices = meshGetIndexPtr(mesh);
+    float *pVertices   = meshGetVertexPtr(mesh);
+    float *pTexCoords  = meshGetTexPtr(mesh);
+    float *pNormals    = meshGetNormalPtr(mesh);
+
+    unsigned tableSize = 16;
+    while(tableSize < stats->vertices * 2) {
+        tableSize *= 2;
+    }
+    // Table entries are unique vertex numbers + 1, so 0 means empty.
+    // For each unique vertex, remember which OBJ vertex it came from.
+    unsigned *table  = (unsigned *)calloc(tableSize, sizeof(unsigned));
+    unsigned *source = (unsigned *)malloc(sizeof(unsigned) * stats->vertices);
+    unsigned unique  = 0;
+
+    for(unsigned i = 0; i < stats->vertices; i++) {
+        unsigned *f   = &pIndices[i * 3];
+        unsigned hash = f[0] * 73856093u ^ f[1] * 19349663u ^ f[2] * 83492791u;
+        unsigned slot = hash & (tableSize - 1);
+        // linear probing until we find the vertex or an empty slot
+        while(table[slot]) {
+            unsigned *g = &pIndices[source[table[slot] - 1] * 3];
+            if(f[0] == g[0] && f[1] == g[1] && f[2] == g[2]) {
+                break;
+            }
+            slot = (slot + 1) & (tableSize - 1);
+        }
+        if(!table[slot]) {
+            float *dest = buffer + unique * 8;
+            dest[0]     = pVertices[f[0] * 3 + 0];
+            dest[1]     = pVertices[f[0] * 3 + 1];
+            dest[2]     = pVertices[f[0] * 3 + 2];
+            dest[3]     = pTexCoords[f[1] * 2 + 0];
+            dest[4]     = pTexCoords[f[1] * 2 + 1];
+            dest[5]     = pNormals[f[2] * 3 + 0];
+            dest[6]     = pNormals[f[2] * 3 + 1];
+            dest[7]     = pNormals[f[2] * 3 + 2];
+
+            source[unique] = i;
+            table[slot]    = ++unique;
+        }
+        indices[i] = table[slot] - 1;
+    }
+    free(source);
+    free(table);
+    return unique;
+}
+
 int countFaceVertices(const char *line) {
     unsigned a, *f = &a;
 
@@ -30,5 +30,8 @@ unsigned meshGetNumFloats(Mesh *mesh);
 unsigned meshGetNumVertices(Mesh *mesh);
 // pack data into target buffer (with space for meshGetNumFloats(mesh) floats)
 void meshPackVertices(Mesh *mesh, float *buffer);
+// pack unique vertices into buffer (sized as above) and write
+// meshGetNumVertices(mesh) indices to them; return number of unique vertices
+unsigned meshPackIndexed(Mesh *mesh, float *buffer, unsigned *indices);
 
 #endif
\ No newline at end of file
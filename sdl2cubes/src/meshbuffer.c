@@ -0,0 +1,176 @@
+/**
+ * meshbuffer.c
+ * Sub-allocate static meshes from one big vertex and index buffer.
+ *
+ * Vertex layout is (vec3 pos, vec2 tex, vec3 normal) in attributes 0-2.
+ * Attribute 3 is an instance number with divisor 1, which lets instanced
+ * draws with a base instance pick their per-object data. It has numbers
+ * for as many instances as mbReserveInstances() was asked for; draws that
+ * don't need it use the plain vertex array, which leaves it out.
+ */
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dsa.h"
+#include "glstate.h"
+#include "meshbuffer.h"
+
+static const unsigned VERTEX_STRIDE = sizeof(float) * (3 + 2 + 3);
+
+static void setupVertexArray(MeshBuffer *mb);
+static GLuint createInstanceBuffer(unsigned instances);
+static GLuint growBuffer(GLuint old, unsigned oldSize, unsigned newSize);
+
+void mbInit(MeshBuffer *mb, unsigned vertices, unsigned indices,
+            unsigned instances) {
+    memset(mb, 0, sizeof(MeshBuffer));
+    mb->vertexCapacity = vertices;
+    mb->indexCapacity  = indices;
+
+    mb->vertexBuffer = dsaCreateBuffer(GL_ARRAY_BUFFER);
+    dsaBufferData(mb->vertexBuffer, vertices * VERTEX_STRIDE, NULL,
+                  GL_STATIC_DRAW);
+
+    mb->indexBuffer = dsaCreateBuffer(GL_ELEMENT_ARRAY_BUFFER);
+    dsaBufferData(mb->indexBuffer, indices * sizeof(GLuint), NULL,
+                  GL_STATIC_DRAW);
+
+    mb->instanceBuffer   = createInstanceBuffer(instances);
+    mb->instanceCapacity = instances;
+
+    mb->vertexArray      = dsaCreateVertexArray();
+    mb->plainVertexArray = dsaCreateVertexArray();
+    setupVertexArray(mb);
+}
+
+RenderMesh mbAddMesh(MeshBuffer *mb, Mesh *mesh) {
+    RenderMesh renderMesh;
+    memset(&renderMesh, 0, sizeof(RenderMesh));
+
+    // Pack the mesh on the CPU first, since we only know how many unique
+    // vertices there are after deduplicating them.
+    unsigned numIndices  = meshGetNumVertices(mesh);
+    unsigned numFloats   = meshGetNumFloats(mesh);
+    float *vertices      = (float *)malloc(sizeof(float) * numFloats);
+    GLuint *indices      = (GLuint *)malloc(sizeof(GLuint) * numIndices);
+    unsigned numVertices = meshPackIndexed(mesh, vertices, indices);
+
+    // The position comes first in each vertex.
+    float radiusSq = 0;
+    for(unsigned i = 0; i < numVertices; i++) {
+        float *pos  = vertices + i * (VERTEX_STRIDE / sizeof(float));
+        float lenSq = pos[0] * pos[0] + pos[1] * pos[1] + pos[2] * pos[2];
+        if(lenSq > radiusSq) {
+            radiusSq = lenSq;
+        }
+    }
+    renderMesh.radius = sqrtf(radiusSq);
+
+    // Make room. This only happens while loading, so copying is fine.
+    int resized = 0;
+    if(mb->vertexCount + numVertices > mb->vertexCapacity) {
+        unsigned capacity = mb->vertexCapacity * 2;
+        if(capacity < mb->vertexCount + numVertices) {
+            capacity = mb->vertexCount + numVertices;
+        }
+        mb->vertexBuffer =
+            growBuffer(mb->vertexBuffer, mb->vertexCount * VERTEX_STRIDE,
+                       capacity * VERTEX_STRIDE);
+        mb->vertexCapacity = capacity;
+        resized            = 1;
+    }
+    if(mb->indexCount + numIndices > mb->indexCapacity) {
+        unsigned capacity = mb->indexCapacity * 2;
+        if(capacity < mb->indexCount + numIndices) {
+            capacity = mb->indexCount + numIndices;
+        }
+        mb->indexBuffer =
+            growBuffer(mb->indexBuffer, mb->indexCount * sizeof(GLuint),
+                       capacity * sizeof(GLuint));
+        mb->indexCapacity = capacity;
+        resized           = 1;
+    }
+    if(resized) {
+        setupVertexArray(mb);
+    }
+
+    dsaBufferSubData(mb->vertexBuffer, mb->vertexCount * VERTEX_STRIDE,
+                     numVertices * VERTEX_STRIDE, vertices);
+    dsaBufferSubData(mb->indexBuffer, mb->indexCount * sizeof(GLuint),
+                     numIndices * sizeof(GLuint), indices);
+    free(vertices);
+    free(indices);
+
+    renderMesh.vertexArray = mb->vertexArray;
+    renderMesh.id          = mb->meshCount++;
+    renderMesh.firstIndex  = mb->indexCount;
+    renderMesh.indices     = numIndices;
+    renderMesh.baseVertex  = mb->vertexCount;
+
+    mb->vertexCount += numVertices;
+    mb->indexCount += numIndices;
+    return renderMesh;
+}
+
+void mbReserveInstances(MeshBuffer *mb, unsigned instances) {
+    if(instances <= mb->instanceCapacity) {
+        return;
+    }
+    unsigned capacity = mb->instanceCapacity ? mb->instanceCapacity : 1;
+    while(capacity < instances) {
+        capacity *= 2;
+    }
+    // Draws that are still using the old numbers keep them alive.
+    gsDeleteBuffers(1, &mb->instanceBuffer);
+    mb->instanceBuffer   = createInstanceBuffer(capacity);
+    mb->instanceCapacity = capacity;
+    setupVertexArray(mb);
+}
+
+// Make a buffer of 0, 1, 2, ... for the instance number input.
+GLuint createInstanceBuffer(unsigned instances) {
+    GLuint *numbers = (GLuint *)malloc(sizeof(GLuint) * instances);
+    for(unsigned i = 0; i < instances; i++) {
+        numbers[i] = i;
+    }
+    GLuint buffer = dsaCreateBuffer(GL_ARRAY_BUFFER);
+    dsaBufferData(buffer, sizeof(GLuint) * instances, numbers,
+                  GL_STATIC_DRAW);
+    free(numbers);
+    return buffer;
+}
+
+// Point the shared vertex arrays at the current buffers.
+void setupVertexArray(MeshBuffer *mb) {
+    GLuint arrays[] = {mb->vertexArray, mb->plainVertexArray};
+    for(int i = 0; i < 2; i++) {
+        GLuint va = arrays[i];
+        // vertex positions, texture coords and normals
+        dsaVertexAttrib(va, 0, mb->vertexBuffer, 3, GL_FLOAT, VERTEX_STRIDE,
+                        0);
+        dsaVertexAttrib(va, 1, mb->vertexBuffer, 2, GL_FLOAT, VERTEX_STRIDE,
+                        sizeof(float) * 3);
+        dsaVertexAttrib(va, 2, mb->vertexBuffer, 3, GL_FLOAT, VERTEX_STRIDE,
+                        sizeof(float) * (3 + 2));
+        dsaVertexArrayElementBuffer(va, mb->indexBuffer);
+    }
+    // The instance number advances once per instance instead of per vertex.
+    dsaVertexAttribI(mb->vertexArray, 3, mb->instanceBuffer, 1,
+                     GL_UNSIGNED_INT, sizeof(GLuint), 0);
+    dsaVertexAttribDivisor(mb->vertexArray, 3, 1);
+}
+
+// Make a bigger copy of a buffer and delete the old one.
+GLuint growBuffer(GLuint old, unsigned oldSize, unsigned newSize) {
+    GLuint buffer = dsaCreateBuffer(GL_COPY_WRITE_BUFFER);
+    dsaBufferData(buffer, newSize, NULL, GL_STATIC_DRAW);
+    if(oldSize) {
+        dsaCopyBufferSubData(old, buffer, 0, 0, oldSize);
+    }
+    gsDeleteBuffers(1, &old);
+    return buffer;
+}
@@ -0,0 +1,50 @@
+#ifndef CUBES_MESHBUFFER_H
+#define CUBES_MESHBUFFER_H
+
+#include "mesh_obj.h"
+
+// A mesh stored in a MeshBuffer.
+typedef struct RenderMesh {
+    GLuint vertexArray;  // vertex array object id (shared by all meshes)
+    unsigned id;         // mesh number within its buffer
+    unsigned firstIndex; // first index in the shared index buffer
+    unsigned indices;    // number of indices
+    int baseVertex;      // added to each index to find the vertex
+    float radius;        // bounding sphere radius around the origin
+} RenderMesh;
+
+// Shared vertex and index storage for static meshes. Every mesh uses the
+// same vertex array, so switching between meshes costs nothing.
+typedef struct MeshBuffer {
+    GLuint vertexArray;        // vertex array object for all the meshes
+    GLuint plainVertexArray;   // same without aInstance, for any instances
+    GLuint vertexBuffer;       // vertex data
+    GLuint indexBuffer;        // index data
+    GLuint instanceBuffer;     // instance numbers for the aInstance input
+    unsigned instanceCapacity; // number of instance numbers in it
+    unsigned vertexCapacity;   // number of vertices there's space for
+    unsigned indexCapacity;    // number of indices there's space for
+    unsigned vertexCount;      // number of vertices in use
+    unsigned indexCount;       // number of indices in use
+    unsigned meshCount;        // number of meshes added
+} MeshBuffer;
+
+// Draw command layout for glMultiDrawElementsIndirect.
+typedef struct DrawElementsCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+} DrawElementsCommand;
+
+// create buffers with initial space for some vertices and indices,
+// and instance numbers for instances instanced draws
+void mbInit(MeshBuffer *mb, unsigned vertices, unsigned indices,
+            unsigned instances);
+// copy a mesh into the buffer, growing it if needed
+RenderMesh mbAddMesh(MeshBuffer *mb, Mesh *mesh);
+// make sure there are instance numbers for this many instances
+void mbReserveInstances(MeshBuffer *mb, unsigned instances);
+
+#endif
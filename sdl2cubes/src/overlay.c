@@ -0,0 +1,346 @@
+/**
+ * overlay.c
+ * Batched 2D overlay.
+ *
+ * Quads are written straight into a ring buffer as they're queued. The
+ * ring never grows, so its vertex array is set up once and each frame's
+ * quads are found with a base vertex. The index buffer is static and
+ * covers OV_MAX_QUADS quads.
+ *
+ * The atlas is a single-channel texture. The font takes the top of it,
+ * one 8x8 cell per character, and its bottom right cell is solid white
+ * for plain rectangles. The rest is free for sprites.
+ */
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <math.h>   // sqrtf
+#include <stddef.h> // offsetof
+#include <string.h>
+#include "dsa.h"
+#include "glstate.h"
+#include "overlay.h"
+#include "shaders.h"
+
+typedef struct OverlayVertex {
+    float x, y;             // pixels
+    unsigned short u, v;    // atlas pixels
+    unsigned char color[4]; // RGBA
+} OverlayVertex;
+
+enum { ATLAS_WIDTH = 128, ATLAS_HEIGHT = 64 };
+enum { CELL_SIZE = 8, CELLS_PER_ROW = ATLAS_WIDTH / CELL_SIZE };
+enum { WHITE_X = ATLAS_WIDTH - CELL_SIZE, WHITE_Y = ATLAS_HEIGHT - CELL_SIZE };
+enum { GLYPH_WIDTH = 5, GLYPH_HEIGHT = 7 };
+enum { FIRST_CHAR = ' ', LAST_CHAR = '~' };
+
+// 5x7 pixel characters from ' ' to '~', one byte per row, the leftmost
+// pixel in bit 4.
+static const unsigned char FONT[LAST_CHAR - FIRST_CHAR + 1][GLYPH_HEIGHT] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}, // space
+    {0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04}, // !
+    {0x0a, 0x0a, 0x0a, 0x00, 0x00, 0x00, 0x00}, // "
+    {0x0a, 0x0a, 0x1f, 0x0a, 0x1f, 0x0a, 0x0a}, // #
+    {0x04, 0x0f, 0x14, 0x0e, 0x05, 0x1e, 0x04}, // $
+    {0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03}, // %
+    {0x0c, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0d}, // &
+    {0x04, 0x04, 0x04, 0x00, 0x00, 0x00, 0x00}, // '
+    {0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02}, // (
+    {0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08}, // )
+    {0x00, 0x04, 0x15, 0x0e, 0x15, 0x04, 0x00}, // *
+    {0x00, 0x04, 0x04, 0x1f, 0x04, 0x04, 0x00}, // +
+    {0x00, 0x00, 0x00, 0x00, 0x0c, 0x04, 0x08}, // ,
+    {0x00, 0x00, 0x00, 0x1f, 0x00, 0x00, 0x00}, // -
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x0c, 0x0c}, // .
+    {0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00}, // /
+    {0x0e, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0e}, // 0
+    {0x04, 0x0c, 0x04, 0x04, 0x04, 0x04, 0x0e}, // 1
+    {0x0e, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1f}, // 2
+    {0x1f, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0e}, // 3
+    {0x02, 0x06, 0x0a, 0x12, 0x1f, 0x02, 0x02}, // 4
+    {0x1f, 0x10, 0x1e, 0x01, 0x01, 0x11, 0x0e}, // 5
+    {0x06, 0x08, 0x10, 0x1e, 0x11, 0x11, 0x0e}, // 6
+    {0x1f, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08}, // 7
+    {0x0e, 0x11, 0x11, 0x0e, 0x11, 0x11, 0x0e}, // 8
+    {0x0e, 0x11, 0x11, 0x0f, 0x01, 0x02, 0x0c}, // 9
+    {0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x0c, 0x00}, // :
+    {0x00, 0x0c, 0x0c, 0x00, 0x0c, 0x04, 0x08}, // ;
+    {0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02}, // <
+    {0x00, 0x00, 0x1f, 0x00, 0x1f, 0x00, 0x00}, // =
+    {0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08}, // >
+    {0x0e, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04}, // ?
+    {0x0e, 0x11, 0x01, 0x0d, 0x15, 0x15, 0x0e}, // @
+    {0x0e, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11}, // A
+    {0x1e, 0x11, 0x11, 0x1e, 0x11, 0x11, 0x1e}, // B
+    {0x0e, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0e}, // C
+    {0x1c, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1c}, // D
+    {0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x1f}, // E
+    {0x1f, 0x10, 0x10, 0x1e, 0x10, 0x10, 0x10}, // F
+    {0x0e, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0f}, // G
+    {0x11, 0x11, 0x11, 0x1f, 0x11, 0x11, 0x11}, // H
+    {0x0e, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e}, // I
+    {0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0c}, // J
+    {0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11}, // K
+    {0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1f}, // L
+    {0x11, 0x1b, 0x15, 0x15, 0x11, 0x11, 0x11}, // M
+    {0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11}, // N
+    {0x0e, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e}, // O
+    {0x1e, 0x11, 0x11, 0x1e, 0x10, 0x10, 0x10}, // P
+    {0x0e, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0d}, // Q
+    {0x1e, 0x11, 0x11, 0x1e, 0x14, 0x12, 0x11}, // R
+    {0x0f, 0x10, 0x10, 0x0e, 0x01, 0x01, 0x1e}, // S
+    {0x1f, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}, // T
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0e}, // U
+    {0x11, 0x11, 0x11, 0x11, 0x11, 0x0a, 0x04}, // V
+    {0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0a}, // W
+    {0x11, 0x11, 0x0a, 0x04, 0x0a, 0x11, 0x11}, // X
+    {0x11, 0x11, 0x11, 0x0a, 0x04, 0x04, 0x04}, // Y
+    {0x1f, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1f}, // Z
+    {0x0e, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0e}, // [
+    {0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00}, // backslash
+    {0x0e, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0e}, // ]
+    {0x04, 0x0a, 0x11, 0x00, 0x00, 0x00, 0x00}, // ^
+    {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f}, // _
+    {0x08, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00}, // `
+    {0x00, 0x00, 0x0e, 0x01, 0x0f, 0x11, 0x0f}, // a
+    {0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1e}, // b
+    {0x00, 0x00, 0x0e, 0x10, 0x10, 0x11, 0x0e}, // c
+    {0x01, 0x01, 0x0d, 0x13, 0x11, 0x11, 0x0f}, // d
+    {0x00, 0x00, 0x0e, 0x11, 0x1f, 0x10, 0x0e}, // e
+    {0x06, 0x09, 0x08, 0x1c, 0x08, 0x08, 0x08}, // f
+    {0x00, 0x0f, 0x11, 0x11, 0x0f, 0x01, 0x0e}, // g
+    {0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11}, // h
+    {0x04, 0x00, 0x0c, 0x04, 0x04, 0x04, 0x0e}, // i
+    {0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0c}, // j
+    {0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12}, // k
+    {0x0c, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0e}, // l
+    {0x00, 0x00, 0x1a, 0x15, 0x15, 0x11, 0x11}, // m
+    {0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11}, // n
+    {0x00, 0x00, 0x0e, 0x11, 0x11, 0x11, 0x0e}, // o
+    {0x00, 0x00, 0x1e, 0x11, 0x1e, 0x10, 0x10}, // p
+    {0x00, 0x00, 0x0d, 0x13, 0x0f, 0x01, 0x01}, // q
+    {0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10}, // r
+    {0x00, 0x00, 0x0e, 0x10, 0x0e, 0x01, 0x1e}, // s
+    {0x08, 0x08, 0x1c, 0x08, 0x08, 0x09, 0x06}, // t
+    {0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0d}, // u
+    {0x00, 0x00, 0x11, 0x11, 0x11, 0x0a, 0x04}, // v
+    {0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0a}, // w
+    {0x00, 0x00, 0x11, 0x0a, 0x04, 0x0a, 0x11}, // x
+    {0x00, 0x00, 0x11, 0x11, 0x0f, 0x01, 0x0e}, // y
+    {0x00, 0x00, 0x1f, 0x02, 0x04, 0x08, 0x1f}, // z
+    {0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02}, // {
+    {0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04}, // |
+    {0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08}, // }
+    {0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00}, // ~
+};
+
+static const char *VERT_SRC =
+    "#version 330\n"
+    "uniform vec2 viewport;\n" // framebuffer size in pixels
+    "layout(location=0) in vec2 aPos;\n"
+    "layout(location=1) in vec2 aTex;\n"
+    "layout(location=2) in vec4 aColor;\n" // 0-255
+    "out vec2 texel;\n"
+    "out vec4 color;\n"
+    "void main() {\n"
+    "    texel = aTex;\n"
+    "    color = aColor / 255.0;\n"
+    "    vec2 pos = aPos / viewport * vec2(2.0, -2.0) + vec2(-1.0, 1.0);\n"
+    "    gl_Position = vec4(pos, 0.0, 1.0);\n"
+    "}\n";
+
+// Quads are drawn at whole-number scales, so fetching the texel under
+// each pixel needs no filtering or normalized coordinates.
+static const char *FRAG_SRC =
+    "#version 330\n"
+    "uniform sampler2D atlas;\n"
+    "in vec2 texel;\n"
+    "in vec4 color;\n"
+    "layout(location=0) out vec4 outColor;\n"
+    "void main() {\n"
+    "    float coverage = texelFetch(atlas, ivec2(texel), 0).r;\n"
+    "    outColor = vec4(color.rgb, color.a * coverage);\n"
+    "}\n";
+
+static GLuint program     = 0;
+static GLint viewportLoc  = -1;
+static GLuint atlas       = 0;
+static GLuint indices     = 0;
+static GLuint vertexArray = 0;
+static RingBuffer *ring   = NULL;
+
+static OverlayVertex *vertices = NULL; // this frame's, in the ring
+static unsigned quads          = 0;    // queued this frame
+static unsigned firstVertex    = 0;    // of this frame in the ring
+static float viewport[2];
+
+static void overlayCompiled(ShaderSourceSpec *spec) {
+    viewportLoc = glGetUniformLocation(*spec->idPtr, "viewport");
+    gsUseProgram(*spec->idPtr);
+    glUniform1i(glGetUniformLocation(*spec->idPtr, "atlas"), 0);
+}
+
+void ovInit() {
+    addShaderString(&program, "overlay", VERT_SRC, FRAG_SRC, NULL,
+                    overlayCompiled);
+}
+
+static GLuint createAtlas() {
+    static unsigned char pixels[ATLAS_HEIGHT][ATLAS_WIDTH];
+    memset(pixels, 0, sizeof(pixels));
+    for(int c = FIRST_CHAR; c <= LAST_CHAR; c++) {
+        int cell = c - FIRST_CHAR;
+        int left = cell % CELLS_PER_ROW * CELL_SIZE;
+        int top  = cell / CELLS_PER_ROW * CELL_SIZE;
+        for(int y = 0; y < GLYPH_HEIGHT; y++) {
+            for(int x = 0; x < GLYPH_WIDTH; x++) {
+                int bit = FONT[cell][y] >> (GLYPH_WIDTH - 1 - x) & 1;
+                pixels[top + y][left + x] = bit ? 255 : 0;
+            }
+        }
+    }
+    for(int y = WHITE_Y; y < WHITE_Y + CELL_SIZE; y++) {
+        memset(&pixels[y][WHITE_X], 255, CELL_SIZE);
+    }
+    GLuint texture = dsaCreateTexture2D();
+    dsaTextureStorage2D(texture, 1, GL_R8, ATLAS_WIDTH, ATLAS_HEIGHT);
+    dsaTextureSubImage2D(texture, 0, 0, 0, ATLAS_WIDTH, ATLAS_HEIGHT, GL_RED,
+                         GL_UNSIGNED_BYTE, pixels);
+    return texture;
+}
+
+GLuint ovCreate(UploadStrategy strategy) {
+    atlas = createAtlas();
+
+    // Every quad is two triangles of its own four vertices.
+    static unsigned short quadIndices[OV_MAX_QUADS * 6];
+    static const unsigned short pattern[6] = {0, 1, 2, 2, 1, 3};
+    for(unsigned i = 0; i < OV_MAX_QUADS * 6; i++) {
+        quadIndices[i] = (unsigned short)(i / 6 * 4 + pattern[i % 6]);
+    }
+    indices = dsaCreateBuffer(GL_ELEMENT_ARRAY_BUFFER);
+    dsaBufferData(indices, sizeof(quadIndices), quadIndices, GL_STATIC_DRAW);
+
+    // Room for a few frames of full batches, so it never has to grow.
+    ring = ringCreate(GL_ARRAY_BUFFER,
+                      sizeof(OverlayVertex) * 4 * OV_MAX_QUADS * 4, strategy);
+    GLuint buffer  = ringGetBuffer(ring);
+    GLsizei stride = sizeof(OverlayVertex);
+    vertexArray    = dsaCreateVertexArray();
+    dsaVertexAttrib(vertexArray, 0, buffer, 2, GL_FLOAT, stride,
+                    offsetof(OverlayVertex, x));
+    dsaVertexAttrib(vertexArray, 1, buffer, 2, GL_UNSIGNED_SHORT, stride,
+                    offsetof(OverlayVertex, u));
+    dsaVertexAttrib(vertexArray, 2, buffer, 4, GL_UNSIGNED_BYTE, stride,
+                    offsetof(OverlayVertex, color));
+    dsaVertexArrayElementBuffer(vertexArray, indices);
+    return atlas;
+}
+
+void ovBegin(int width, int height) {
+    viewport[0] = (float)width;
+    viewport[1] = (float)height;
+    quads       = 0;
+    // The write stays open until ovFlush(), which keeps what was used.
+    unsigned offset;
+    vertices = (OverlayVertex *)ringBeginWrite(
+        ring, sizeof(OverlayVertex) * 4 * OV_MAX_QUADS,
+        sizeof(OverlayVertex), &offset);
+    firstVertex = offset / sizeof(OverlayVertex);
+}
+
+static void setVertex(OverlayVertex *vertex, float x, float y, int u, int v,
+                      unsigned color) {
+    vertex->x        = x;
+    vertex->y        = y;
+    vertex->u        = (unsigned short)u;
+    vertex->v        = (unsigned short)v;
+    vertex->color[0] = color >> 24;
+    vertex->color[1] = color >> 16 & 0xff;
+    vertex->color[2] = color >> 8 & 0xff;
+    vertex->color[3] = color & 0xff;
+}
+
+void ovSprite(float x, float y, float w, float h, int atlasX, int atlasY,
+              int atlasW, int atlasH, unsigned color) {
+    if(quads == OV_MAX_QUADS) {
+        return;
+    }
+    // The vertices may be in write-combined memory, so they're written in
+    // order and never read.
+    OverlayVertex *quad = vertices + quads * 4;
+    setVertex(quad + 0, x, y, atlasX, atlasY, color);
+    setVertex(quad + 1, x + w, y, atlasX + atlasW, atlasY, color);
+    setVertex(quad + 2, x, y + h, atlasX, atlasY + atlasH, color);
+    setVertex(quad + 3, x + w, y + h, atlasX + atlasW, atlasY + atlasH,
+              color);
+    quads++;
+}
+
+void ovRect(float x, float y, float w, float h, unsigned color) {
+    // Sample the middle of the white cell so the edges never bleed.
+    ovSprite(x, y, w, h, WHITE_X + CELL_SIZE / 2, WHITE_Y + CELL_SIZE / 2,
+             0, 0, color);
+}
+
+void ovLine(float x0, float y0, float x1, float y1, float width,
+            unsigned color) {
+    float dx = x1 - x0, dy = y1 - y0;
+    float length = sqrtf(dx * dx + dy * dy);
+    if(quads == OV_MAX_QUADS || length == 0) {
+        return;
+    }
+    // The sides are the ends moved half the width either way.
+    float nx = -dy / length * width * 0.5f;
+    float ny = dx / length * width * 0.5f;
+    int u    = WHITE_X + CELL_SIZE / 2;
+    int v    = WHITE_Y + CELL_SIZE / 2;
+
+    OverlayVertex *quad = vertices + quads * 4;
+    setVertex(quad + 0, x0 + nx, y0 + ny, u, v, color);
+    setVertex(quad + 1, x1 + nx, y1 + ny, u, v, color);
+    setVertex(quad + 2, x0 - nx, y0 - ny, u, v, color);
+    setVertex(quad + 3, x1 - nx, y1 - ny, u, v, color);
+    quads++;
+}
+
+float ovText(float x, float y, int scale, unsigned color, const char *text) {
+    float left = x;
+    for(const char *c = text; *c; c++) {
+        if(*c == '\n') {
+            x = left;
+            y += OV_GLYPH_HEIGHT * scale;
+            continue;
+        }
+        if(*c > FIRST_CHAR && *c <= LAST_CHAR) {
+            int cell = *c - FIRST_CHAR;
+            ovSprite(x, y, GLYPH_WIDTH * scale, GLYPH_HEIGHT * scale,
+                     cell % CELLS_PER_ROW * CELL_SIZE,
+                     cell / CELLS_PER_ROW * CELL_SIZE, GLYPH_WIDTH,
+                     GLYPH_HEIGHT, color);
+        }
+        x += OV_GLYPH_WIDTH * scale;
+    }
+    return x;
+}
+
+unsigned ovFlush() {
+    unsigned drawn = quads;
+    ringEndWrite(ring, sizeof(OverlayVertex) * 4 * quads);
+    ringEndFrame(ring);
+    vertices = NULL;
+    quads    = 0;
+    if(!drawn) {
+        return 0;
+    }
+    gsUseProgram(program);
+    glUniform2f(viewportLoc, viewport[0], viewport[1]);
+    gsBindVertexArray(vertexArray);
+    gsBindTexture(0, GL_TEXTURE_2D, atlas);
+    gsEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glDrawElementsBaseVertex(GL_TRIANGLES, drawn * 6, GL_UNSIGNED_SHORT, NULL,
+                             firstVertex);
+    gsDisable(GL_BLEND);
+    return drawn;
+}
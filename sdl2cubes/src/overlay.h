@@ -0,0 +1,38 @@
+#ifndef CUBES_OVERLAY_H
+#define CUBES_OVERLAY_H
+
+#include "ringbuffer.h"
+
+// 2D text and sprites drawn over the finished frame, in pixels from the
+// top left corner of the window. Everything queued between ovBegin() and
+// ovFlush() is streamed into one vertex buffer and drawn with one call,
+// so a screenful of text costs next to nothing.
+
+// size of a character cell at scale 1, including spacing
+enum { OV_GLYPH_WIDTH = 6, OV_GLYPH_HEIGHT = 9 };
+// quads that fit in a frame; the rest are dropped
+enum { OV_MAX_QUADS = 4096 };
+
+// register the overlay shader; call before reloadShaders()
+void ovInit();
+// create the overlay's buffers and its atlas texture, which has the font
+// in it; return the atlas
+GLuint ovCreate(UploadStrategy strategy);
+// start queueing quads for a framebuffer of the given size
+void ovBegin(int width, int height);
+// queue a rectangle of the atlas, given in atlas pixels; colors are
+// 0xRRGGBBAA and multiply the atlas
+void ovSprite(float x, float y, float w, float h, int atlasX, int atlasY,
+              int atlasW, int atlasH, unsigned color);
+// queue a solid rectangle
+void ovRect(float x, float y, float w, float h, unsigned color);
+// queue a line segment; strips of them make graphs
+void ovLine(float x0, float y0, float x1, float y1, float width,
+            unsigned color);
+// queue text at a whole-number scale; '\n' starts a new line; return the
+// x coordinate the text ended at
+float ovText(float x, float y, int scale, unsigned color, const char *text);
+// draw everything queued since ovBegin(); return the number of quads
+unsigned ovFlush();
+
+#endif
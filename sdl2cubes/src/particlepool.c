@@ -0,0 +1,186 @@
+/**
+ * particlepool.c
+ * Structure of arrays particle storage with SIMD updates.
+ *
+ * The update kernel is written once in terms of the v* macros below,
+ * which map to AVX, SSE or plain floats depending on what the compiler is
+ * allowed to use. Build with -mavx (or -march=native) to get the 8-wide
+ * version; x86-64 always has SSE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "particlepool.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+enum { WIDTH = 8 };
+typedef __m256 vfloat;
+#define vload(p) _mm256_load_ps(p)
+#define vstore(p, a) _mm256_store_ps(p, a)
+#define vset1(a) _mm256_set1_ps(a)
+#define vadd(a, b) _mm256_add_ps(a, b)
+#define vmul(a, b) _mm256_mul_ps(a, b)
+#define vlt(a, b) _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+// GCC turns a blendv of a compare into branches with plain AVX (AVX2 is
+// fine), so use masks instead.
+#define vselect(mask, a, b) \
+    _mm256_or_ps(_mm256_and_ps(mask, a), _mm256_andnot_ps(mask, b))
+static const char *INSTRUCTION_SET = "AVX";
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+enum { WIDTH = 4 };
+typedef __m128 vfloat;
+#define vload(p) _mm_load_ps(p)
+#define vstore(p, a) _mm_store_ps(p, a)
+#define vset1(a) _mm_set1_ps(a)
+#define vadd(a, b) _mm_add_ps(a, b)
+#define vmul(a, b) _mm_mul_ps(a, b)
+#define vlt(a, b) _mm_cmplt_ps(a, b)
+#define vselect(mask, a, b) \
+    _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b))
+static const char *INSTRUCTION_SET = "SSE";
+#else
+enum { WIDTH = 1 };
+typedef float vfloat;
+#define vload(p) (*(p))
+#define vstore(p, a) (*(p) = (a))
+#define vset1(a) (a)
+#define vadd(a, b) ((a) + (b))
+#define vmul(a, b) ((a) * (b))
+#define vlt(a, b) ((a) < (b))
+#define vselect(mask, a, b) ((mask) ? (a) : (b))
+static const char *INSTRUCTION_SET = "scalar";
+#endif
+
+// Each array starts aligned for the widest loads.
+enum { ALIGN = PP_BLOCK * sizeof(float) };
+enum { NUM_ARRAYS = 8 };
+
+void ppInit(ParticlePool *pool, unsigned capacity) {
+    memset(pool, 0, sizeof(ParticlePool));
+    capacity = (capacity + PP_BLOCK - 1) / PP_BLOCK * PP_BLOCK;
+    size_t arrayBytes = sizeof(float) * capacity;
+
+    // The padding has to hold sane numbers too, since it gets updated.
+    pool->memory = calloc(1, arrayBytes * NUM_ARRAYS + ALIGN);
+    uintptr_t base = ((uintptr_t)pool->memory + ALIGN - 1) &
+                     ~(uintptr_t)(ALIGN - 1);
+    float **arrays[NUM_ARRAYS] = {&pool->x,  &pool->y,  &pool->z,
+                                  &pool->vx, &pool->vy, &pool->vz,
+                                  &pool->age, &pool->life};
+    for(int i = 0; i < NUM_ARRAYS; i++) {
+        *arrays[i] = (float *)(base + arrayBytes * i);
+    }
+    pool->capacity = capacity;
+}
+
+void ppFree(ParticlePool *pool) {
+    free(pool->memory);
+    memset(pool, 0, sizeof(ParticlePool));
+}
+
+int ppSpawn(ParticlePool *pool, const float position[3],
+            const float velocity[3], float life) {
+    if(pool->count == pool->capacity) {
+        return 0;
+    }
+    unsigned i    = pool->count++;
+    pool->x[i]    = position[0];
+    pool->y[i]    = position[1];
+    pool->z[i]    = position[2];
+    pool->vx[i]   = velocity[0];
+    pool->vy[i]   = velocity[1];
+    pool->vz[i]   = velocity[2];
+    pool->age[i]  = 0;
+    pool->life[i] = life;
+    return 1;
+}
+
+void ppUpdateRange(ParticlePool *pool, const ParticleForces *forces,
+                   float dt, unsigned first, unsigned count) {
+    unsigned end = first + (count + PP_BLOCK - 1) / PP_BLOCK * PP_BLOCK;
+    if(end > pool->capacity) {
+        end = pool->capacity;
+    }
+    float damping = 1 - forces->drag * dt;
+    if(damping < 0) {
+        damping = 0;
+    }
+    vfloat vdt     = vset1(dt);
+    vfloat gx      = vset1(forces->gravity[0] * dt);
+    vfloat gy      = vset1(forces->gravity[1] * dt);
+    vfloat gz      = vset1(forces->gravity[2] * dt);
+    vfloat damp    = vset1(damping);
+    vfloat floorY  = vset1(forces->floorY);
+    vfloat rebound = vset1(-forces->bounce);
+
+    // Stores through these could change *pool as far as the compiler
+    // knows, so keep the pointers in locals.
+    float *px = pool->x, *py = pool->y, *pz = pool->z;
+    float *pvx = pool->vx, *pvy = pool->vy, *pvz = pool->vz;
+    float *page = pool->age;
+
+    for(unsigned i = first; i < end; i += WIDTH) {
+        vfloat vx = vmul(vadd(vload(pvx + i), gx), damp);
+        vfloat vy = vmul(vadd(vload(pvy + i), gy), damp);
+        vfloat vz = vmul(vadd(vload(pvz + i), gz), damp);
+        vfloat x  = vadd(vload(px + i), vmul(vx, vdt));
+        vfloat y  = vadd(vload(py + i), vmul(vy, vdt));
+        vfloat z  = vadd(vload(pz + i), vmul(vz, vdt));
+
+        // Particles that went through the floor are put back on it and
+        // bounce back up.
+        vfloat below = vlt(y, floorY);
+        y            = vselect(below, floorY, y);
+        vy           = vselect(below, vmul(vy, rebound), vy);
+
+        vstore(px + i, x);
+        vstore(py + i, y);
+        vstore(pz + i, z);
+        vstore(pvx + i, vx);
+        vstore(pvy + i, vy);
+        vstore(pvz + i, vz);
+        vstore(page + i, vadd(vload(page + i), vdt));
+    }
+}
+
+unsigned ppCompact(ParticlePool *pool) {
+    // Fill each dead particle's slot with the last live particle. This
+    // doesn't keep the order, but additive particles don't care.
+    unsigned i = 0;
+    while(i < pool->count) {
+        if(pool->age[i] < pool->life[i]) {
+            i++;
+            continue;
+        }
+        unsigned last = --pool->count;
+        pool->x[i]    = pool->x[last];
+        pool->y[i]    = pool->y[last];
+        pool->z[i]    = pool->z[last];
+        pool->vx[i]   = pool->vx[last];
+        pool->vy[i]   = pool->vy[last];
+        pool->vz[i]   = pool->vz[last];
+        pool->age[i]  = pool->age[last];
+        pool->life[i] = pool->life[last];
+    }
+    return pool->count;
+}
+
+void ppWriteInstances(const ParticlePool *pool, float *dest, unsigned first,
+                      unsigned count) {
+    // The destination may be write-combined memory, so write it in order
+    // and never read it back.
+    for(unsigned i = first; i < first + count; i++) {
+        dest[0] = pool->x[i];
+        dest[1] = pool->y[i];
+        dest[2] = pool->z[i];
+        dest[3] = 1 - pool->age[i] / pool->life[i];
+        dest += 4;
+    }
+}
+
+const char *ppInstructionSet() {
+    return INSTRUCTION_SET;
+}
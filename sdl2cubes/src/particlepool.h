@@ -0,0 +1,51 @@
+#ifndef CUBES_PARTICLEPOOL_H
+#define CUBES_PARTICLEPOOL_H
+
+// CPU-side particles for effects that need logic the GPU system can't do,
+// like collisions or scripted forces. Particles are stored as separate
+// arrays per component (structure of arrays), so the update runs on
+// several particles at once with SSE or AVX. Live particles are kept
+// packed at the front of the arrays.
+
+// Particles are updated this many at a time. The arrays are padded to a
+// multiple of it, so ranges can be rounded up to it.
+enum { PP_BLOCK = 8 };
+
+typedef struct ParticlePool {
+    float *x, *y, *z;    // position
+    float *vx, *vy, *vz; // velocity
+    float *age, *life;   // seconds since spawning, seconds to live
+    unsigned count;      // live particles
+    unsigned capacity;   // particle slots, a multiple of PP_BLOCK
+    void *memory;        // allocation holding all the arrays
+} ParticlePool;
+
+// forces applied in ppUpdateRange()
+typedef struct ParticleForces {
+    float gravity[3]; // acceleration
+    float drag;       // fraction of velocity lost per second
+    float floorY;     // height of the floor plane
+    float bounce;     // fraction of vertical speed kept by a bounce
+} ParticleForces;
+
+// allocate space for capacity particles
+void ppInit(ParticlePool *pool, unsigned capacity);
+// free the pool's memory
+void ppFree(ParticlePool *pool);
+// add a particle; return 0 if the pool is full
+int ppSpawn(ParticlePool *pool, const float position[3],
+            const float velocity[3], float life);
+// move particles [first, first + count) forward by dt seconds; first must
+// be a multiple of PP_BLOCK, count is rounded up to one
+void ppUpdateRange(ParticlePool *pool, const ParticleForces *forces,
+                   float dt, unsigned first, unsigned count);
+// remove dead particles, moving live ones into their slots; return count
+unsigned ppCompact(ParticlePool *pool);
+// write (x, y, z, fade) for particles [first, first + count) to dest,
+// where fade goes from 1 at birth to 0 at death
+void ppWriteInstances(const ParticlePool *pool, float *dest, unsigned first,
+                      unsigned count);
+// get the name of the instruction set the update uses
+const char *ppInstructionSet();
+
+#endif
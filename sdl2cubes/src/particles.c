@@ -0,0 +1,270 @@
+/**
+ * particles.c
+ * Transform feedback particle system.
+ *
+ * Each particle is two vec4s: (position, age) and (velocity, lifetime).
+ * Every update runs the update shader over all particles in one buffer
+ * and captures the results into the other, then the buffers swap roles.
+ * Slots are handed out to emitters in order, so the shader finds a
+ * particle's emitter from gl_VertexID. A particle whose age passes its
+ * lifetime is respawned by its emitter with random values hashed from
+ * the slot and the time. Negative ages mean not born yet, which staggers
+ * the first wave.
+ */
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dsa.h"
+#include "glstate.h"
+#include "particles.h"
+#include "shaders.h"
+
+typedef struct Particle {
+    float position[3];
+    float age;
+    float velocity[3];
+    float life;
+} Particle;
+
+struct ParticleSystem {
+    unsigned capacity;      // number of particle slots
+    unsigned used;          // slots owned by emitters
+    GLuint buffers[2];      // particle state, ping-ponged
+    GLuint vertexArrays[2]; // reading buffers[i]
+    unsigned current;       // index of the buffer with the latest state
+    ParticleEmitter emitters[PS_MAX_EMITTERS];
+    int numEmitters;
+    float gravity[3];
+};
+
+static const char *UPDATE_VERT_SRC =
+    "#version 330\n"
+    "uniform float dt;\n"
+    "uniform float time;\n"
+    "uniform vec3 gravity;\n"
+    "uniform int numEmitters;\n"
+    "uniform int emitterEnd[8];\n"  // PS_MAX_EMITTERS; slot after the last
+    "uniform vec4 emitterPos[8];\n" // position, spread
+    "uniform vec4 emitterVel[8];\n" // velocity, life
+    "layout(location=0) in vec4 aPosAge;\n"
+    "layout(location=1) in vec4 aVelLife;\n"
+    "out vec4 posAge;\n"
+    "out vec4 velLife;\n"
+    // integer hash to [0, 1]
+    "float hash(uint x) {\n"
+    "    x ^= x >> 16u;\n"
+    "    x *= 0x7feb352du;\n"
+    "    x ^= x >> 15u;\n"
+    "    x *= 0x846ca68bu;\n"
+    "    x ^= x >> 16u;\n"
+    "    return float(x) * (1.0 / 4294967295.0);\n"
+    "}\n"
+    "void main() {\n"
+    "    vec3 pos = aPosAge.xyz, vel = aVelLife.xyz;\n"
+    "    float age = aPosAge.w + dt, life = aVelLife.w;\n"
+    "    int e = 0;\n"
+    "    while(e < numEmitters && gl_VertexID >= emitterEnd[e]) {\n"
+    "        e++;\n"
+    "    }\n"
+    "    if(age >= life && e < numEmitters) {\n"
+    "        uint seed = uint(gl_VertexID) * 747796405u +\n"
+    "                    floatBitsToUint(time) * 2891336453u;\n"
+    "        vec3 dir = vec3(hash(seed), hash(seed + 1u),\n"
+    "                        hash(seed + 2u)) * 2.0 - 1.0;\n"
+    "        pos  = emitterPos[e].xyz;\n"
+    "        vel  = emitterVel[e].xyz + dir * emitterPos[e].w;\n"
+    "        age  = min(age - life, dt);\n"
+    "        life = emitterVel[e].w * (0.5 + hash(seed + 3u));\n"
+    "    } else if(age >= 0.0) {\n"
+    "        vel += gravity * dt;\n"
+    "        pos += vel * dt;\n"
+    "    }\n"
+    "    posAge  = vec4(pos, age);\n"
+    "    velLife = vec4(vel, life);\n"
+    "}\n";
+
+static const char *const UPDATE_VARYINGS[] = {"posAge", "velLife"};
+
+static const char *DRAW_VERT_SRC =
+    "#version 330\n"
+    "layout(std140) uniform FrameParams {\n"
+    "    mat4 projection;\n"
+    "    float time;\n"
+    "    mat4 view;\n"
+    "};\n"
+    "uniform float pointSize;\n" // in pixels at distance 1
+    "layout(location=0) in vec4 aPosAge;\n"
+    "layout(location=1) in vec4 aVelLife;\n"
+    "out float fade;\n"
+    "void main() {\n"
+    "    float t = aPosAge.w / aVelLife.w;\n"
+    "    vec4 pos = view * vec4(aPosAge.xyz, 1.0);\n"
+    "    gl_Position  = projection * pos;\n"
+    "    gl_PointSize = pointSize / max(-pos.z, 0.1);\n"
+    "    fade = 1.0 - t;\n"
+    "    if(aPosAge.w < 0.0 || t >= 1.0) {\n"
+    "        gl_Position = vec4(0.0, 0.0, 2.0, 1.0);\n" // clipped
+    "    }\n"
+    "}\n";
+
+static const char *DRAW_FRAG_SRC =
+    "#version 330\n"
+    "in float fade;\n"
+    "layout(location=0) out vec4 outColor;\n"
+    "void main() {\n"
+    "    vec2 d = gl_PointCoord * 2.0 - 1.0;\n"
+    "    float a = max(0.0, 1.0 - dot(d, d)) * fade;\n"
+    "    outColor = vec4(1.0, 0.6, 0.2, 1.0) * a;\n"
+    "}\n";
+
+static GLuint updateProgram = 0;
+static GLuint drawProgram   = 0;
+
+// uniform locations of the update program
+static struct {
+    GLint dt, time, gravity, numEmitters, emitterEnd, emitterPos,
+        emitterVel;
+} updateLocs;
+static GLint pointSizeLoc = -1;
+
+static void updateCompiled(ShaderSourceSpec *spec) {
+    GLuint p               = *spec->idPtr;
+    updateLocs.dt          = glGetUniformLocation(p, "dt");
+    updateLocs.time        = glGetUniformLocation(p, "time");
+    updateLocs.gravity     = glGetUniformLocation(p, "gravity");
+    updateLocs.numEmitters = glGetUniformLocation(p, "numEmitters");
+    updateLocs.emitterEnd  = glGetUniformLocation(p, "emitterEnd");
+    updateLocs.emitterPos  = glGetUniformLocation(p, "emitterPos");
+    updateLocs.emitterVel  = glGetUniformLocation(p, "emitterVel");
+}
+
+static void drawCompiled(ShaderSourceSpec *spec) {
+    pointSizeLoc = glGetUniformLocation(*spec->idPtr, "pointSize");
+}
+
+void psInit() {
+    addFeedbackShaderString(&updateProgram, "particle update",
+                            UPDATE_VERT_SRC, UPDATE_VARYINGS, 2,
+                            updateCompiled);
+    addShaderString(&drawProgram, "particle draw", DRAW_VERT_SRC,
+                    DRAW_FRAG_SRC, NULL, drawCompiled);
+}
+
+ParticleSystem *psCreate(unsigned capacity) {
+    ParticleSystem *ps = (ParticleSystem *)malloc(sizeof(ParticleSystem));
+    memset(ps, 0, sizeof(ParticleSystem));
+    ps->capacity = capacity;
+
+    // Everything starts dead, waiting up to a second to be born.
+    Particle *initial = (Particle *)malloc(sizeof(Particle) * capacity);
+    memset(initial, 0, sizeof(Particle) * capacity);
+    for(unsigned i = 0; i < capacity; i++) {
+        initial[i].age = -(float)rand() / RAND_MAX;
+    }
+    for(int i = 0; i < 2; i++) {
+        GLuint buffer = dsaCreateBuffer(GL_ARRAY_BUFFER);
+        dsaBufferData(buffer, sizeof(Particle) * capacity, initial,
+                      GL_DYNAMIC_COPY);
+        GLuint va = dsaCreateVertexArray();
+        dsaVertexAttrib(va, 0, buffer, 4, GL_FLOAT, sizeof(Particle), 0);
+        dsaVertexAttrib(va, 1, buffer, 4, GL_FLOAT, sizeof(Particle),
+                        sizeof(float) * 4);
+        ps->buffers[i]      = buffer;
+        ps->vertexArrays[i] = va;
+    }
+    free(initial);
+    printf("particle system with %u particles, %u KiB\n", capacity,
+           (unsigned)(sizeof(Particle) * capacity * 2 >> 10));
+    return ps;
+}
+
+void psDestroy(ParticleSystem *ps) {
+    if(!ps) {
+        return;
+    }
+    gsDeleteVertexArrays(2, ps->vertexArrays);
+    gsDeleteBuffers(2, ps->buffers);
+    free(ps);
+}
+
+int psAddEmitter(ParticleSystem *ps, const ParticleEmitter *emitter) {
+    if(ps->numEmitters == PS_MAX_EMITTERS ||
+       emitter->count > ps->capacity - ps->used) {
+        return -1;
+    }
+    ps->emitters[ps->numEmitters] = *emitter;
+    ps->used += emitter->count;
+    return ps->numEmitters++;
+}
+
+void psSetEmitter(ParticleSystem *ps, int index,
+                  const ParticleEmitter *emitter) {
+    unsigned count            = ps->emitters[index].count;
+    ps->emitters[index]       = *emitter;
+    ps->emitters[index].count = count;
+}
+
+void psSetGravity(ParticleSystem *ps, float x, float y, float z) {
+    ps->gravity[0] = x;
+    ps->gravity[1] = y;
+    ps->gravity[2] = z;
+}
+
+void psUpdate(ParticleSystem *ps, float dt, float time) {
+    GLint ends[PS_MAX_EMITTERS];
+    float positions[PS_MAX_EMITTERS][4], velocities[PS_MAX_EMITTERS][4];
+    unsigned end = 0;
+    for(int i = 0; i < ps->numEmitters; i++) {
+        ParticleEmitter *e = &ps->emitters[i];
+        end += e->count;
+        ends[i] = (GLint)end;
+        memcpy(positions[i], e->position, sizeof(float) * 3);
+        memcpy(velocities[i], e->velocity, sizeof(float) * 3);
+        positions[i][3]  = e->spread;
+        velocities[i][3] = e->life;
+    }
+    gsUseProgram(updateProgram);
+    glUniform1f(updateLocs.dt, dt);
+    glUniform1f(updateLocs.time, time);
+    glUniform3fv(updateLocs.gravity, 1, ps->gravity);
+    glUniform1i(updateLocs.numEmitters, ps->numEmitters);
+    if(ps->numEmitters) {
+        glUniform1iv(updateLocs.emitterEnd, ps->numEmitters, ends);
+        glUniform4fv(updateLocs.emitterPos, ps->numEmitters, positions[0]);
+        glUniform4fv(updateLocs.emitterVel, ps->numEmitters, velocities[0]);
+    }
+
+    // Run the shader over the current state and capture the next state.
+    // Slots no emitter owns are never touched.
+    unsigned next = 1 - ps->current;
+    gsBindVertexArray(ps->vertexArrays[ps->current]);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, ps->buffers[next]);
+    gsEnable(GL_RASTERIZER_DISCARD);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, ps->used);
+    glEndTransformFeedback();
+    gsDisable(GL_RASTERIZER_DISCARD);
+    // Unbind it so it's not bound for capture while it's drawn from.
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    ps->current = next;
+}
+
+void psDraw(ParticleSystem *ps, float renderScale) {
+    // Additive blending doesn't care about order, so the particles don't
+    // need sorting. They're tested against the scene's depth but don't
+    // write it.
+    gsUseProgram(drawProgram);
+    // a 20 pixel blob 10 units away, at full resolution
+    glUniform1f(pointSizeLoc, 200.0f * renderScale);
+    gsBindVertexArray(ps->vertexArrays[ps->current]);
+    gsEnable(GL_PROGRAM_POINT_SIZE);
+    gsEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    gsDepthMask(GL_FALSE);
+    glDrawArrays(GL_POINTS, 0, ps->used);
+    gsDepthMask(GL_TRUE);
+    gsDisable(GL_BLEND);
+}
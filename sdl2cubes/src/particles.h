@@ -0,0 +1,43 @@
+#ifndef CUBES_PARTICLES_H
+#define CUBES_PARTICLES_H
+
+// Particles simulated entirely on the GPU with transform feedback.
+// The CPU only sets up emitters and forces; spawning, moving and killing
+// particles all happen in a vertex shader, so the cost of a frame doesn't
+// depend on the number of particles on the CPU side.
+
+enum { PS_MAX_EMITTERS = 8 };
+
+// A source of particles. Each emitter owns a fixed number of particle
+// slots and respawns the particles in them as they die, so the rate of
+// emission is count / life particles per second.
+typedef struct ParticleEmitter {
+    float position[3];
+    float velocity[3]; // starting velocity
+    float spread;      // largest random speed added in any direction
+    float life;        // average lifetime in seconds
+    unsigned count;    // particle slots owned by the emitter
+} ParticleEmitter;
+
+typedef struct ParticleSystem ParticleSystem;
+
+// register the particle shaders; call before reloadShaders()
+void psInit();
+// create a system with space for capacity particles
+ParticleSystem *psCreate(unsigned capacity);
+// release the system and its GL objects
+void psDestroy(ParticleSystem *ps);
+// add an emitter; return its index, or -1 if there are no slots left
+int psAddEmitter(ParticleSystem *ps, const ParticleEmitter *emitter);
+// move or change an emitter; its count can't change
+void psSetEmitter(ParticleSystem *ps, int index,
+                  const ParticleEmitter *emitter);
+// set the acceleration applied to every particle
+void psSetGravity(ParticleSystem *ps, float x, float y, float z);
+// advance the simulation by dt seconds; time seeds the random numbers
+void psUpdate(ParticleSystem *ps, float dt, float time);
+// draw the particles as additive point sprites with FrameParams' camera;
+// renderScale is the size of the target relative to the window
+void psDraw(ParticleSystem *ps, float renderScale);
+
+#endif
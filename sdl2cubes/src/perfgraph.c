@@ -0,0 +1,99 @@
+/**
+ * perfgraph.c
+ * Frame timing graphs.
+ *
+ * Every series keeps its samples in a ring indexed by frame, so all of
+ * them line up. The graph is queued into the overlay as line segments and
+ * rectangles, so it doesn't add any draw calls of its own.
+ */
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <stdio.h>
+#include <string.h>
+#include "overlay.h"
+#include "perfgraph.h"
+
+typedef struct PerfSeries {
+    char name[16];
+    unsigned color;
+    float samples[PG_HISTORY]; // negative for frames without one
+} PerfSeries;
+
+static PerfSeries series[PG_MAX_SERIES];
+static int numSeries    = 0;
+static unsigned current = 0; // index of this frame's samples
+
+// frame time budgets marked on the graph, for 60 and 120 Hz
+static const float BUDGETS[] = {16.6f, 8.3f};
+
+int pgAddSeries(const char *name, unsigned color) {
+    if(numSeries == PG_MAX_SERIES) {
+        return -1;
+    }
+    PerfSeries *s = &series[numSeries];
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    s->color = color;
+    for(int i = 0; i < PG_HISTORY; i++) {
+        s->samples[i] = -1;
+    }
+    return numSeries++;
+}
+
+void pgSample(int index, float millis) {
+    if(index >= 0 && index < numSeries) {
+        series[index].samples[current] = millis;
+    }
+}
+
+void pgEndFrame() {
+    current = (current + 1) % PG_HISTORY;
+    for(int i = 0; i < numSeries; i++) {
+        series[i].samples[current] = -1;
+    }
+}
+
+void pgDraw(float x, float y, float w, float h, float maxMillis) {
+    ovRect(x, y, w, h, 0x000000a0);
+    char label[32];
+    for(unsigned i = 0; i < sizeof(BUDGETS) / sizeof(BUDGETS[0]); i++) {
+        float lineY = y + h - h * BUDGETS[i] / maxMillis;
+        ovRect(x, lineY, w, 1, 0xffffff60);
+        snprintf(label, sizeof(label), "%.1f ms", BUDGETS[i]);
+        ovText(x + w + 4, lineY - OV_GLYPH_HEIGHT / 2, 1, 0xffffffc0, label);
+    }
+
+    // Oldest samples on the left, values past the top clamped to it.
+    float step = w / (PG_HISTORY - 1);
+    for(int i = 0; i < numSeries; i++) {
+        PerfSeries *s = &series[i];
+        float lastX = 0, lastY = 0;
+        int hasLast = 0;
+        for(int j = 0; j < PG_HISTORY; j++) {
+            float millis = s->samples[(current + 1 + j) % PG_HISTORY];
+            if(millis < 0) {
+                hasLast = 0;
+                continue;
+            }
+            if(millis > maxMillis) {
+                millis = maxMillis;
+            }
+            float sampleX = x + j * step;
+            float sampleY = y + h - h * millis / maxMillis;
+            if(hasLast) {
+                ovLine(lastX, lastY, sampleX, sampleY, 1.5f, s->color);
+            }
+            lastX   = sampleX;
+            lastY   = sampleY;
+            hasLast = 1;
+        }
+        // The legend shows the latest sample; this frame's may not be in.
+        float latest = s->samples[(current + PG_HISTORY - 1) % PG_HISTORY];
+        if(latest < 0) {
+            snprintf(label, sizeof(label), "%s", s->name);
+        } else {
+            snprintf(label, sizeof(label), "%s %.2f", s->name, latest);
+        }
+        ovText(x + 4, y + 4 + i * OV_GLYPH_HEIGHT, 1, s->color, label);
+    }
+}
@@ -0,0 +1,20 @@
+#ifndef CUBES_PERFGRAPH_H
+#define CUBES_PERFGRAPH_H
+
+// Rolling graphs of frame timings, drawn with the overlay. Each series
+// is something measured once per frame, like the CPU or GPU time of the
+// whole frame or of a pass. The graph shows the last PG_HISTORY frames.
+
+enum { PG_HISTORY = 240, PG_MAX_SERIES = 8 };
+
+// add a series drawn in color (0xRRGGBBAA); return its index
+int pgAddSeries(const char *name, unsigned color);
+// set a series' sample for the current frame, in milliseconds
+void pgSample(int series, float millis);
+// move on to the next frame; series without a sample leave a gap
+void pgEndFrame();
+// queue the graph and its legend into the overlay, scaled so that the top
+// of the graph is maxMillis
+void pgDraw(float x, float y, float w, float h, float maxMillis);
+
+#endif
@@ -0,0 +1,138 @@
+/**
+ * renderqueue.c
+ * Sortable list of draws.
+ *
+ * The sort key is laid out so that the most expensive state changes are
+ * in the most significant bits:
+ *
+ *   63      54 53     46 45       34 33    24 23                  0
+ *   | program | vtxarray | texture   | mesh   | depth               |
+ *
+ * GL object names are usually small integers handed out in order, so the
+ * low bits of the names are used as-is. If two names collide the items just
+ * sort next to each other; the draw state itself is always read from the
+ * item, not the key.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "renderqueue.h"
+
+enum {
+    KEY_PROGRAM_BITS      = 10,
+    KEY_VERTEXARRAY_BITS  = 8,
+    KEY_TEXTURE_BITS      = 12,
+    KEY_MESH_BITS         = 10,
+    KEY_DEPTH_BITS        = 24,
+    KEY_DEPTH_SHIFT       = 0,
+    KEY_MESH_SHIFT        = KEY_DEPTH_SHIFT + KEY_DEPTH_BITS,
+    KEY_TEXTURE_SHIFT     = KEY_MESH_SHIFT + KEY_MESH_BITS,
+    KEY_VERTEXARRAY_SHIFT = KEY_TEXTURE_SHIFT + KEY_TEXTURE_BITS,
+    KEY_PROGRAM_SHIFT     = KEY_VERTEXARRAY_SHIFT + KEY_VERTEXARRAY_BITS,
+};
+
+static uint64_t keyField(unsigned value, unsigned bits, unsigned shift) {
+    return ((uint64_t)value & ((1u << bits) - 1)) << shift;
+}
+
+uint64_t rqMakeKey(unsigned program, unsigned vertexArray, unsigned texture,
+                   unsigned mesh, float depth) {
+    // clamp so objects behind the camera or past the far plane still sort
+    if(depth < 0) {
+        depth = 0;
+    } else if(depth > 1) {
+        depth = 1;
+    }
+    unsigned depthBits = (unsigned)(depth * ((1u << KEY_DEPTH_BITS) - 1));
+
+    return keyField(program, KEY_PROGRAM_BITS, KEY_PROGRAM_SHIFT) |
+           keyField(vertexArray, KEY_VERTEXARRAY_BITS,
+                    KEY_VERTEXARRAY_SHIFT) |
+           keyField(texture, KEY_TEXTURE_BITS, KEY_TEXTURE_SHIFT) |
+           keyField(mesh, KEY_MESH_BITS, KEY_MESH_SHIFT) |
+           keyField(depthBits, KEY_DEPTH_BITS, KEY_DEPTH_SHIFT);
+}
+
+void rqInit(RenderQueue *queue, unsigned capacity) {
+    memset(queue, 0, sizeof(RenderQueue));
+    queue->items    = (RenderItem *)malloc(sizeof(RenderItem) * capacity);
+    queue->capacity = capacity;
+}
+
+void rqFree(RenderQueue *queue) {
+    free(queue->items);
+    memset(queue, 0, sizeof(RenderQueue));
+}
+
+void rqReserve(RenderQueue *queue, unsigned capacity) {
+    if(capacity <= queue->capacity) {
+        return;
+    }
+    queue->items =
+        (RenderItem *)realloc(queue->items, sizeof(RenderItem) * capacity);
+    queue->capacity = capacity;
+}
+
+RenderItem *rqPush(RenderQueue *queue) {
+    if(queue->count == queue->capacity) {
+        // Doubling keeps the number of reallocations logarithmic.
+        rqReserve(queue, queue->capacity ? queue->capacity * 2 : 64);
+    }
+    return &queue->items[queue->count++];
+}
+
+int rqSameState(const RenderItem *a, const RenderItem *b) {
+    return a->program == b->program && a->vertexArray == b->vertexArray &&
+           a->texture == b->texture;
+}
+
+int rqSameMesh(const RenderItem *a, const RenderItem *b) {
+    return rqSameState(a, b) && a->firstIndex == b->firstIndex &&
+           a->indices == b->indices && a->baseVertex == b->baseVertex;
+}
+
+// LSD radix sort, one byte of the key at a time. This is stable, so
+// items with equal keys stay in the order they were queued in.
+void rqSort(RenderQueue *queue, RenderItem *scratch) {
+    unsigned count = queue->count;
+    if(count < 2) {
+        return;
+    }
+    // Count all the digits in one go.
+    unsigned histogram[8][256];
+    memset(histogram, 0, sizeof(histogram));
+    for(unsigned i = 0; i < count; i++) {
+        uint64_t key = queue->items[i].key;
+        for(int d = 0; d < 8; d++) {
+            histogram[d][(key >> (d * 8)) & 0xff]++;
+        }
+    }
+
+    RenderItem *src = queue->items;
+    RenderItem *dst = scratch;
+    for(int d = 0; d < 8; d++) {
+        unsigned *h = histogram[d];
+        // If every key has the same digit here, this pass would be a copy.
+        if(h[(src[0].key >> (d * 8)) & 0xff] == count) {
+            continue;
+        }
+        // Turn the counts into starting offsets.
+        unsigned sum = 0;
+        for(int b = 0; b < 256; b++) {
+            unsigned n = h[b];
+            h[b]       = sum;
+            sum += n;
+        }
+        for(unsigned i = 0; i < count; i++) {
+            unsigned b  = (src[i].key >> (d * 8)) & 0xff;
+            dst[h[b]++] = src[i];
+        }
+        RenderItem *tmp = src;
+        src             = dst;
+        dst             = tmp;
+    }
+    // After an odd number of passes the sorted items are in scratch.
+    if(src != queue->items) {
+        memcpy(queue->items, src, sizeof(RenderItem) * count);
+    }
+}
@@ -0,0 +1,48 @@
+#ifndef CUBES_RENDERQUEUE_H
+#define CUBES_RENDERQUEUE_H
+
+#include <stdint.h>
+
+// A single queued draw. Items are sorted by key before drawing, so that
+// draws sharing a shader, vertex array and texture end up next to each
+// other and the state only has to be set once for all of them. Draws of
+// the same mesh are grouped within those.
+typedef struct RenderItem {
+    uint64_t key;         // sort key, see rqMakeKey()
+    unsigned program;     // shader program id
+    unsigned vertexArray; // vertex array object id
+    unsigned texture;     // texture bound to unit 0
+    unsigned mesh;        // mesh number (see RenderMesh)
+    unsigned firstIndex;  // first index to draw
+    unsigned indices;     // number of indices to draw
+    int baseVertex;       // added to each index
+    unsigned transform;   // index of the object's ObjectParams
+} RenderItem;
+
+// Array of render items that grows as needed.
+typedef struct RenderQueue {
+    RenderItem *items; // queued items
+    unsigned count;    // number of queued items
+    unsigned capacity; // number of items there's space for
+} RenderQueue;
+
+// pack draw state, mesh number and view depth (0..1) into a sort key
+uint64_t rqMakeKey(unsigned program, unsigned vertexArray, unsigned texture,
+                   unsigned mesh, float depth);
+// allocate space for capacity items
+void rqInit(RenderQueue *queue, unsigned capacity);
+// free the queue's memory
+void rqFree(RenderQueue *queue);
+// make sure there's space for capacity items
+void rqReserve(RenderQueue *queue, unsigned capacity);
+// add an item, growing the queue if it's full; return pointer to it
+RenderItem *rqPush(RenderQueue *queue);
+// sort the items by key using scratch space for queue->count items;
+// equal keys keep their order
+void rqSort(RenderQueue *queue, RenderItem *scratch);
+// check if two items can be drawn without changing state
+int rqSameState(const RenderItem *a, const RenderItem *b);
+// check if two items can be instances of the same draw
+int rqSameMesh(const RenderItem *a, const RenderItem *b);
+
+#endif
@@ -0,0 +1,392 @@
+/**
+ * ringbuffer.c
+ * Stream per-frame data to the GPU without waiting for it to finish reading
+ * the previous frames' data.
+ *
+ * The buffer is split into segments. A segment that was written during a
+ * frame gets a fence at the end of that frame, and the fence has to be
+ * signaled before the segment can be written again. Each frame starts from
+ * a fresh segment, so as long as the buffer holds a few frames' worth of
+ * data this never has to wait.
+ *
+ * How the bytes actually get into the buffer is up to an UploadOps table,
+ * since the fastest way to do it varies between drivers.
+ */
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <SDL2/SDL.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dsa.h"
+#include "glstate.h"
+#include "ringbuffer.h"
+
+enum { RING_SEGMENTS = 8 };
+
+// how long to wait for a fence in one go (nanoseconds)
+static const GLuint64 FENCE_TIMEOUT = 1000000;
+
+// Upload strategy implementation.
+typedef struct UploadOps {
+    const char *name;
+    int fenced; // nonzero if the strategy relies on our fences for safety
+    // create storage for the ring's buffer, which is currently bound
+    void (*init)(RingBuffer *ring);
+    // get writable memory for a range of the buffer
+    void *(*map)(RingBuffer *ring, unsigned ofs, unsigned size);
+    // make the first used bytes of a mapped range visible to GL
+    void (*unmap)(RingBuffer *ring, unsigned ofs, unsigned used);
+    // called when the cursor wraps back to the start (may be NULL)
+    void (*wrap)(RingBuffer *ring);
+} UploadOps;
+
+typedef struct RingBuffer {
+    const UploadOps *ops;
+    GLenum target;     // buffer target the buffer is used with
+    GLuint buffer;     // GL buffer id
+    unsigned capacity; // total size in bytes
+    unsigned segSize;  // size of a fenced segment
+    unsigned cursor;   // next free byte
+    unsigned pending;  // size of the write in progress (0 if none)
+    unsigned pendingOfs;    // offset of the write in progress
+    unsigned frameBytes;    // bytes written during this frame
+    unsigned char *mapping; // persistent mapping or NULL
+    unsigned char *staging; // CPU-side copy for the glBufferSubData paths
+    unsigned stagingSize;
+    // fences guarding segments that previous frames wrote into
+    GLsync fences[RING_SEGMENTS];
+    // segments written during this frame
+    unsigned char touched[RING_SEGMENTS];
+    RingStats stats;
+} RingBuffer;
+
+static void waitSegment(RingBuffer *ring, unsigned seg);
+
+// ---- upload strategies ----
+
+static void initMutable(RingBuffer *ring) {
+    dsaBufferData(ring->buffer, ring->capacity, NULL, GL_STREAM_DRAW);
+}
+
+static void *mapStaging(RingBuffer *ring, unsigned ofs, unsigned size) {
+    (void)ofs;
+    if(size > ring->stagingSize) {
+        free(ring->staging);
+        ring->staging     = (unsigned char *)malloc(size);
+        ring->stagingSize = size;
+    }
+    return ring->staging;
+}
+
+static void unmapSubData(RingBuffer *ring, unsigned ofs, unsigned used) {
+    dsaBufferSubData(ring->buffer, ofs, used, ring->staging);
+}
+
+// Give the old storage to the driver, which keeps it around until the GPU
+// is done with it, and start filling a fresh one.
+static void wrapOrphan(RingBuffer *ring) {
+    dsaBufferData(ring->buffer, ring->capacity, NULL, GL_STREAM_DRAW);
+}
+
+static void *mapUnsynchronized(RingBuffer *ring, unsigned ofs,
+                               unsigned size) {
+    // The fences already guarantee the range is not in use, so the driver
+    // does not need to synchronize (or copy) anything.
+    return dsaMapBufferRange(ring->buffer, ofs, size,
+                             GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT |
+                                 GL_MAP_INVALIDATE_RANGE_BIT);
+}
+
+static void unmapUnsynchronized(RingBuffer *ring, unsigned ofs,
+                                unsigned used) {
+    (void)ofs;
+    (void)used;
+    dsaUnmapBuffer(ring->buffer);
+}
+
+static void initPersistent(RingBuffer *ring) {
+    // Immutable storage can stay mapped while the GPU uses it.
+    // Coherent mapping means writes become visible without flushing.
+    GLbitfield flags =
+        GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    dsaBufferStorage(ring->buffer, ring->capacity, NULL, flags);
+    ring->mapping = (unsigned char *)dsaMapBufferRange(
+        ring->buffer, 0, ring->capacity, flags);
+}
+
+static void *mapPersistent(RingBuffer *ring, unsigned ofs, unsigned size) {
+    (void)size;
+    return ring->mapping + ofs;
+}
+
+static void unmapPersistent(RingBuffer *ring, unsigned ofs, unsigned used) {
+    (void)ring;
+    (void)ofs;
+    (void)used;
+}
+
+static const UploadOps UPLOAD_OPS[NUM_UPLOAD_STRATEGIES] = {
+    {"subdata", 0, initMutable, mapStaging, unmapSubData, NULL},
+    {"orphan", 0, initMutable, mapStaging, unmapSubData, wrapOrphan},
+    {"unsynchronized", 1, initMutable, mapUnsynchronized, unmapUnsynchronized,
+     NULL},
+    {"persistent", 1, initPersistent, mapPersistent, unmapPersistent, NULL},
+};
+
+const char *ringStrategyName(UploadStrategy strategy) {
+    if(strategy == UPLOAD_AUTO) {
+        return "auto";
+    }
+    return UPLOAD_OPS[strategy].name;
+}
+
+UploadStrategy ringStrategyFromName(const char *name) {
+    for(int i = 0; i < NUM_UPLOAD_STRATEGIES; i++) {
+        if(strcmp(name, UPLOAD_OPS[i].name) == 0) {
+            return (UploadStrategy)i;
+        }
+    }
+    return UPLOAD_AUTO;
+}
+
+int ringStrategySupported(UploadStrategy strategy) {
+    if(strategy == UPLOAD_PERSISTENT) {
+        return GLEW_ARB_buffer_storage;
+    }
+    return strategy >= 0 && strategy < NUM_UPLOAD_STRATEGIES;
+}
+
+// ---- ring buffer ----
+
+RingBuffer *ringCreate(GLenum target, unsigned capacity,
+                       UploadStrategy strategy) {
+    if(!ringStrategySupported(strategy)) {
+        printf("warning: upload strategy %s not supported\n",
+               ringStrategyName(strategy));
+        strategy = UPLOAD_UNSYNCHRONIZED;
+    }
+    RingBuffer *ring = (RingBuffer *)malloc(sizeof(RingBuffer));
+    memset(ring, 0, sizeof(RingBuffer));
+    // round up to whole segments
+    ring->segSize  = (capacity + RING_SEGMENTS - 1) / RING_SEGMENTS;
+    ring->capacity = ring->segSize * RING_SEGMENTS;
+    ring->target   = target;
+    ring->ops      = &UPLOAD_OPS[strategy];
+
+    ring->buffer = dsaCreateBuffer(target);
+    ring->ops->init(ring);
+
+    ring->stats.capacity = ring->capacity;
+    ring->stats.strategy = strategy;
+    return ring;
+}
+
+void ringDestroy(RingBuffer *ring) {
+    if(!ring) {
+        return;
+    }
+    for(unsigned i = 0; i < RING_SEGMENTS; i++) {
+        if(ring->fences[i]) {
+            glDeleteSync(ring->fences[i]);
+        }
+    }
+    if(ring->mapping) {
+        dsaUnmapBuffer(ring->buffer);
+    }
+    gsDeleteBuffers(1, &ring->buffer);
+    free(ring->staging);
+    free(ring);
+}
+
+GLuint ringGetBuffer(RingBuffer *ring) {
+    return ring->buffer;
+}
+
+void ringReserve(RingBuffer *ring, unsigned size) {
+    assert(!ring->pending);
+    if(size <= ring->capacity / 2) {
+        return;
+    }
+    unsigned capacity = ring->capacity;
+    while(size > capacity / 2) {
+        capacity *= 2;
+    }
+    // Deleting the old buffer is safe even if the GPU is still reading it;
+    // GL keeps the storage around until the draws using it are done.
+    for(unsigned i = 0; i < RING_SEGMENTS; i++) {
+        if(ring->fences[i]) {
+            glDeleteSync(ring->fences[i]);
+            ring->fences[i] = NULL;
+        }
+        ring->touched[i] = 0;
+    }
+    if(ring->mapping) {
+        dsaUnmapBuffer(ring->buffer);
+        ring->mapping = NULL;
+    }
+    gsDeleteBuffers(1, &ring->buffer);
+
+    ring->segSize  = capacity / RING_SEGMENTS;
+    ring->capacity = ring->segSize * RING_SEGMENTS;
+    ring->cursor   = 0;
+    ring->buffer   = dsaCreateBuffer(ring->target);
+    ring->ops->init(ring);
+
+    ring->stats.capacity = ring->capacity;
+    printf("ring buffer grown to %u KiB\n", ring->capacity >> 10);
+}
+
+void *ringBeginWrite(RingBuffer *ring, unsigned size, unsigned align,
+                     unsigned *offset) {
+    assert(!ring->pending && "ring buffer writes can't be nested");
+    // A single write has to leave room for the frames the GPU is still
+    // reading, or it would just wait on itself.
+    assert(size <= ring->capacity / 2);
+
+    unsigned ofs = ring->cursor + (align - ring->cursor % align) % align;
+    if(ofs + size > ring->capacity) {
+        ofs = 0; // wrap around; the tail is left unused for this lap
+        if(ring->ops->wrap) {
+            ring->ops->wrap(ring);
+        }
+    }
+    // Make sure the GPU is done with every segment we're about to write.
+    unsigned first = ofs / ring->segSize;
+    unsigned last  = (ofs + size - 1) / ring->segSize;
+    for(unsigned seg = first; seg <= last; seg++) {
+        if(!ring->touched[seg]) {
+            waitSegment(ring, seg);
+            ring->touched[seg] = 2; // by this write only, see ringEndWrite
+        }
+    }
+    ring->pending    = size;
+    ring->pendingOfs = ofs;
+    *offset          = ofs;
+    return ring->ops->map(ring, ofs, size);
+}
+
+void ringEndWrite(RingBuffer *ring, unsigned used) {
+    assert(ring->pending && used <= ring->pending);
+    ring->ops->unmap(ring, ring->pendingOfs, used);
+    ring->cursor = ring->pendingOfs + used;
+    // Segments that only the unused end of the write reached don't need a
+    // fence, and fencing them would make the next frame wait for this one.
+    for(unsigned seg = 0; seg < RING_SEGMENTS; seg++) {
+        if(ring->touched[seg] == 2) {
+            ring->touched[seg] = seg * ring->segSize < ring->cursor;
+        }
+    }
+    ring->frameBytes += used;
+    ring->pending = 0;
+}
+
+void ringEndFrame(RingBuffer *ring) {
+    assert(!ring->pending);
+    int wrote = 0;
+    for(unsigned i = 0; i < RING_SEGMENTS; i++) {
+        if(ring->touched[i]) {
+            // The driver keeps track of buffers it filled by itself.
+            if(ring->ops->fenced) {
+                ring->fences[i] =
+                    glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            }
+            ring->touched[i] = 0;
+            wrote            = 1;
+        }
+    }
+    // Continuing in the segment we just fenced would mean waiting for this
+    // frame to finish on the next one, so skip to the next segment.
+    if(wrote) {
+        unsigned seg = (ring->cursor + ring->segSize - 1) / ring->segSize;
+        // Skipping past the last segment wraps around just like a write
+        // that doesn't fit, so the strategy has to hear about it.
+        if(seg == RING_SEGMENTS && ring->ops->wrap) {
+            ring->ops->wrap(ring);
+        }
+        ring->cursor = (seg % RING_SEGMENTS) * ring->segSize;
+    }
+    ring->stats.frameBytes = ring->frameBytes;
+    ring->frameBytes       = 0;
+}
+
+RingStats ringGetStats(RingBuffer *ring) {
+    return ring->stats;
+}
+
+// Wait until the GPU has finished reading a segment.
+void waitSegment(RingBuffer *ring, unsigned seg) {
+    GLsync fence = ring->fences[seg];
+    if(!fence) {
+        return;
+    }
+    GLenum res = glClientWaitSync(fence, 0, 0);
+    if(res == GL_TIMEOUT_EXPIRED) {
+        ring->stats.stalls++;
+        do {
+            res = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                   FENCE_TIMEOUT);
+        } while(res == GL_TIMEOUT_EXPIRED);
+    }
+    if(res == GL_WAIT_FAILED) {
+        fprintf(stderr, "warning: ring buffer fence wait failed\n");
+    }
+    glDeleteSync(fence);
+    ring->fences[seg] = NULL;
+}
+
+// ---- calibration ----
+
+enum { CALIBRATION_FRAMES = 32 };
+
+UploadStrategy ringCalibrate(GLenum target, unsigned capacity,
+                             unsigned batchSize, unsigned batches,
+                             unsigned align) {
+    UploadStrategy best = UPLOAD_UNSYNCHRONIZED;
+    double bestTime     = -1;
+
+    // Copying from the ring makes the GPU read each batch like a draw call
+    // would, so the strategies have to deal with the same hazards.
+    GLuint sink = dsaCreateBuffer(GL_COPY_WRITE_BUFFER);
+    dsaBufferData(sink, batchSize, NULL, GL_STREAM_COPY);
+
+    for(int s = 0; s < NUM_UPLOAD_STRATEGIES; s++) {
+        UploadStrategy strategy = (UploadStrategy)s;
+        if(!ringStrategySupported(strategy)) {
+            printf("upload strategy %-14s: not supported\n",
+                   ringStrategyName(strategy));
+            continue;
+        }
+        RingBuffer *ring = ringCreate(target, capacity, strategy);
+        glFinish();
+        Uint64 start = SDL_GetPerformanceCounter();
+        for(int frame = 0; frame < CALIBRATION_FRAMES; frame++) {
+            for(unsigned i = 0; i < batches; i++) {
+                unsigned ofs = 0;
+                void *dest   = ringBeginWrite(ring, batchSize, align, &ofs);
+                memset(dest, frame, batchSize);
+                ringEndWrite(ring, batchSize);
+                dsaCopyBufferSubData(ring->buffer, sink, ofs, 0, batchSize);
+            }
+            ringEndFrame(ring);
+            glFlush();
+        }
+        glFinish();
+        Uint64 end = SDL_GetPerformanceCounter();
+        ringDestroy(ring);
+
+        double ms = (double)(end - start) * 1000.0 /
+                    SDL_GetPerformanceFrequency() / CALIBRATION_FRAMES;
+        printf("upload strategy %-14s: %.3f ms/frame\n",
+               ringStrategyName(strategy), ms);
+        if(bestTime < 0 || ms < bestTime) {
+            best     = strategy;
+            bestTime = ms;
+        }
+    }
+    gsDeleteBuffers(1, &sink);
+    printf("using upload strategy %s\n", ringStrategyName(best));
+    return best;
+}
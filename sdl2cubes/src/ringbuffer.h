@@ -0,0 +1,57 @@
+#ifndef CUBES_RINGBUFFER_H
+#define CUBES_RINGBUFFER_H
+
+// Streaming buffer for data that is rewritten every frame.
+typedef struct RingBuffer RingBuffer;
+
+// Ways to get data into the buffer. Which one is fastest depends heavily on
+// the driver, so ringCalibrate() can be used to pick one at startup.
+typedef enum UploadStrategy {
+    UPLOAD_AUTO = -1,      // measure and pick the fastest one
+    UPLOAD_SUBDATA,        // glBufferSubData from a CPU-side copy
+    UPLOAD_ORPHAN,         // glBufferData(NULL) once per lap + glBufferSubData
+    UPLOAD_UNSYNCHRONIZED, // glMapBufferRange with manual fencing
+    UPLOAD_PERSISTENT,     // persistent coherent mapping (ARB_buffer_storage)
+    NUM_UPLOAD_STRATEGIES
+} UploadStrategy;
+
+// ring buffer usage statistics
+typedef struct RingStats {
+    unsigned capacity;   // size of the GL buffer in bytes
+    unsigned frameBytes; // bytes written during the last frame
+    unsigned stalls;     // times the CPU had to wait for the GPU
+    UploadStrategy strategy;
+} RingStats;
+
+// create a ring buffer of (at least) capacity bytes for a buffer target
+RingBuffer *ringCreate(GLenum target, unsigned capacity,
+                       UploadStrategy strategy);
+// release the ring buffer and its GL buffer
+void ringDestroy(RingBuffer *ring);
+// get the GL buffer id, e.g. for glBindBufferRange
+GLuint ringGetBuffer(RingBuffer *ring);
+// grow the buffer so that a single write of size bytes fits; invalidates
+// any ranges of it that are bound, so only call this between writes
+void ringReserve(RingBuffer *ring, unsigned size);
+// start writing size bytes at an offset aligned to align; return pointer
+void *ringBeginWrite(RingBuffer *ring, unsigned size, unsigned align,
+                     unsigned *offset);
+// finish the current write, keeping the first used bytes of it
+void ringEndWrite(RingBuffer *ring, unsigned used);
+// mark the end of a frame's writes so the GPU can be tracked
+void ringEndFrame(RingBuffer *ring);
+// get usage statistics
+RingStats ringGetStats(RingBuffer *ring);
+
+// get printable name of an upload strategy
+const char *ringStrategyName(UploadStrategy strategy);
+// look up an upload strategy by name; return UPLOAD_AUTO if not found
+UploadStrategy ringStrategyFromName(const char *name);
+// check if the GL implementation supports an upload strategy
+int ringStrategySupported(UploadStrategy strategy);
+// time each supported strategy with frames of batches; return the fastest
+UploadStrategy ringCalibrate(GLenum target, unsigned capacity,
+                             unsigned batchSize, unsigned batches,
+                             unsigned align);
+
+#endif
@@ -0,0 +1,129 @@
+/**
+ * rtpool.c
+ * Pooled offscreen render targets.
+ *
+ * Creating a target means allocating video memory and validating a new
+ * framebuffer, which can take long enough to hitch a frame, so targets
+ * are kept and reused for as long as something keeps asking for them.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "rtpool.h"
+#include "dsa.h"
+#include "glstate.h"
+
+static RenderTarget targets[RT_MAX_TARGETS];
+static unsigned frame = 0; // frames since rtInit()
+static RenderTargetStats stats;
+
+void rtInit() {
+    memset(targets, 0, sizeof(targets));
+    memset(&stats, 0, sizeof(stats));
+}
+
+// Color formats the demo uses, and RGBA8 for anything else.
+static unsigned bytesPerPixel(GLenum format) {
+    switch(format) {
+    case GL_RGBA16F: return 8;
+    case GL_RGBA32F: return 16;
+    default: return 4;
+    }
+}
+
+// Depth is always a 24-bit buffer, which takes 4 bytes per pixel.
+static double targetBytes(const RenderTarget *target) {
+    return (double)target->width * target->height *
+           (bytesPerPixel(target->format) + 4);
+}
+
+static void freeTarget(RenderTarget *target) {
+    gsDeleteFramebuffers(1, &target->framebuffer);
+    gsDeleteTextures(1, &target->color);
+    glDeleteRenderbuffers(1, &target->depth);
+    stats.live--;
+    stats.frees++;
+    stats.bytes -= targetBytes(target);
+    memset(target, 0, sizeof(RenderTarget));
+}
+
+static void createTarget(RenderTarget *target, int width, int height,
+                         GLenum format) {
+    target->width  = width;
+    target->height = height;
+    target->format = format;
+    target->color  = dsaCreateTexture2D();
+    dsaTextureStorage2D(target->color, 1, format, width, height);
+    dsaTextureParameteri(target->color, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    target->depth = dsaCreateRenderbuffer();
+    dsaRenderbufferStorage(target->depth, GL_DEPTH_COMPONENT24, width,
+                           height);
+
+    target->framebuffer = dsaCreateFramebuffer();
+    dsaFramebufferTexture(target->framebuffer, GL_COLOR_ATTACHMENT0,
+                          target->color, 0);
+    dsaFramebufferRenderbuffer(target->framebuffer, GL_DEPTH_ATTACHMENT,
+                               target->depth);
+    if(dsaCheckFramebufferStatus(target->framebuffer) !=
+       GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "error: %dx%d render target is incomplete\n", width,
+                height);
+    }
+    stats.live++;
+    stats.allocations++;
+    stats.bytes += targetBytes(target);
+}
+
+RenderTarget *rtAcquire(int width, int height, GLenum format) {
+    RenderTarget *empty = NULL, *oldest = NULL;
+    for(int i = 0; i < RT_MAX_TARGETS; i++) {
+        RenderTarget *target = &targets[i];
+        if(!target->framebuffer) {
+            empty = empty ? empty : target;
+        } else if(!target->acquired) {
+            if(target->width == width && target->height == height &&
+               target->format == format) {
+                target->acquired  = 1;
+                target->lastFrame = frame;
+                stats.reuses++;
+                return target;
+            }
+            if(!oldest || target->lastFrame < oldest->lastFrame) {
+                oldest = target;
+            }
+        }
+    }
+    // Make room by dropping the free target that was used longest ago.
+    if(!empty && oldest) {
+        freeTarget(oldest);
+        empty = oldest;
+    }
+    if(!empty) {
+        fprintf(stderr, "error: all %d render targets are in use\n",
+                RT_MAX_TARGETS);
+        return NULL;
+    }
+    createTarget(empty, width, height, format);
+    empty->acquired  = 1;
+    empty->lastFrame = frame;
+    return empty;
+}
+
+void rtRelease(RenderTarget *target) {
+    target->acquired = 0;
+}
+
+void rtEndFrame() {
+    for(int i = 0; i < RT_MAX_TARGETS; i++) {
+        RenderTarget *target = &targets[i];
+        if(target->framebuffer && !target->acquired &&
+           frame - target->lastFrame > RT_MAX_IDLE) {
+            freeTarget(target);
+        }
+    }
+    frame++;
+}
+
+RenderTargetStats rtGetStats() {
+    return stats;
+}
@@ -0,0 +1,47 @@
+#ifndef CUBES_RTPOOL_H
+#define CUBES_RTPOOL_H
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+// A pool of offscreen render targets, each a framebuffer with a color
+// texture and a depth buffer, found by size and color format. Passes
+// acquire a target for as long as they render to it or read from it and
+// then release it, so a later pass that needs the same kind can reuse it.
+// Targets are never resized, since the textures have immutable storage;
+// ones that go unused for RT_MAX_IDLE frames are freed instead.
+
+enum { RT_MAX_TARGETS = 16 }; // targets in the pool at once
+enum { RT_MAX_IDLE = 60 };    // frames a free target is kept around
+
+typedef struct RenderTarget {
+    GLuint framebuffer;
+    GLuint color; // texture
+    GLuint depth; // renderbuffer
+    int width, height;
+    GLenum format;      // of the color texture
+    int acquired;       // 1 while a pass is using it
+    unsigned lastFrame; // frame it was last acquired on
+} RenderTarget;
+
+typedef struct RenderTargetStats {
+    unsigned live;        // targets in the pool
+    unsigned allocations; // targets created since rtInit()
+    unsigned frees;       // targets deleted since rtInit()
+    unsigned reuses;      // acquires that found a target to reuse
+    double bytes;         // memory of the targets in the pool, roughly
+} RenderTargetStats;
+
+// start with an empty pool
+void rtInit();
+// get a free target of this size and color format, creating one if there
+// isn't any; return NULL if the pool is full of acquired targets
+RenderTarget *rtAcquire(int width, int height, GLenum format);
+// let other passes use a target again
+void rtRelease(RenderTarget *target);
+// finish the frame, freeing targets that have been idle for long enough
+void rtEndFrame();
+// get the pool's size and allocation counts
+RenderTargetStats rtGetStats();
+
+#endif
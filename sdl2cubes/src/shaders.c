@@ -3,7 +3,9 @@
 #include <string.h>
 #define GLEW_STATIC
 #include <GL/glew.h>
+#include "glstate.h"
 #include "shaders.h"
+#include "trace.h"
 
 ShaderSourceSpec *shaderSpecs = NULL;
 
@@ -59,21 +61,39 @@ GLuint buildShaderStageFromFile(GLenum type, const char *filename) {
     return shader;
 }
 
+// Build a stage from either a file or a string, depending on the spec.
+GLuint buildShaderStageFromSpec(ShaderSourceSpec *spec, GLenum type,
+                                const char *src) {
+    if(spec->inMemory) {
+        const char *stage = type == GL_VERTEX_SHADER     ? "vertex"
+                            : type == GL_FRAGMENT_SHADER ? "fragment"
+                                                         : "geometry";
+        char id[128];
+        snprintf(id, sizeof(id), "%s %s shader", spec->name, stage);
+        return buildShaderStage(type, src, id);
+    }
+    return buildShaderStageFromFile(type, src);
+}
+
 void buildShaderFromSpecs(ShaderSourceSpec *spec) {
     GLuint program = 0, vertex = 0, fragment = 0, geometry = 0;
     GLint ok = 0;
 
-    vertex = buildShaderStageFromFile(GL_VERTEX_SHADER, spec->vertFile);
+    vertex = buildShaderStageFromSpec(spec, GL_VERTEX_SHADER, spec->vertFile);
     if(!vertex) {
         goto exit;
     }
-    fragment = buildShaderStageFromFile(GL_FRAGMENT_SHADER, spec->fragFile);
-    if(!fragment) {
-        goto exit;
+    // Transform feedback programs may stop at the vertex stage.
+    if(spec->fragFile) {
+        fragment =
+            buildShaderStageFromSpec(spec, GL_FRAGMENT_SHADER, spec->fragFile);
+        if(!fragment) {
+            goto exit;
+        }
     }
     if(spec->geomFile) {
         geometry =
-            buildShaderStageFromFile(GL_GEOMETRY_SHADER, spec->geomFile);
+            buildShaderStageFromSpec(spec, GL_GEOMETRY_SHADER, spec->geomFile);
         if(!geometry) {
             goto exit;
         }
@@ -81,11 +101,18 @@ void buildShaderFromSpecs(ShaderSourceSpec *spec) {
 
     program = glCreateProgram();
     glAttachShader(program, vertex);
-    glAttachShader(program, fragment);
-
+    if(fragment) {
+        glAttachShader(program, fragment);
+    }
     if(geometry) {
         glAttachShader(program, geometry);
     }
+    // This only takes effect when the program is linked.
+    if(spec->numFeedbackVaryings) {
+        glTransformFeedbackVaryings(program, spec->numFeedbackVaryings,
+                                    spec->feedbackVaryings,
+                                    GL_INTERLEAVED_ATTRIBS);
+    }
 
     glLinkProgram(program);
     glGetProgramiv(program, GL_LINK_STATUS, &ok);
@@ -95,10 +122,11 @@ void buildShaderFromSpecs(ShaderSourceSpec *spec) {
         if(logSize > 0) {
             GLchar *log = (GLchar *)malloc(logSize);
             glGetProgramInfoLog(program, logSize, NULL, log);
-            fprintf(stderr, "Shader link failed: %s\n", log);
+            fprintf(stderr, "Shader \"%s\" link failed: %s\n",
+                    spec->inMemory ? spec->name : spec->vertFile, log);
             free(log);
         }
-        glDeleteProgram(program);
+        gsDeleteProgram(program);
         program = 0;
     }
 
@@ -127,11 +155,12 @@ void bindUniformBlock(int program, int slot, const char *name) {
 }
 
 void reloadShaders() {
+    TRACE_BEGIN("reloadShaders");
     // go through the shader source specs and replace the shaders.
     ShaderSourceSpec *spec = shaderSpecs;
     while(spec) {
         if(*spec->idPtr) {
-            glDeleteProgram(*spec->idPtr);
+            gsDeleteProgram(*spec->idPtr);
             *spec->idPtr = 0;
         }
         buildShaderFromSpecs(spec);
@@ -146,6 +175,7 @@ void reloadShaders() {
         }
         spec = (ShaderSourceSpec *)spec->next;
     }
+    TRACE_END();
 }
 
 void addShaderSource(GLuint *idPtr, const char *vertFile, const char *fragFile,
@@ -166,3 +196,21 @@ void addShaderSource(GLuint *idPtr, const char *vertFile, const char *fragFile,
     }
     shaderSpecs = spec;
 }
+
+void addShaderString(GLuint *idPtr, const char *name, const char *vertSrc,
+                     const char *fragSrc, const char *geomSrc,
+                     void (*postCompile)(ShaderSourceSpec *)) {
+    addShaderSource(idPtr, vertSrc, fragSrc, geomSrc, postCompile);
+    // addShaderSource pushed the new spec to the front of the list
+    shaderSpecs->inMemory = 1;
+    shaderSpecs->name     = name;
+}
+
+void addFeedbackShaderString(GLuint *idPtr, const char *name,
+                             const char *vertexSrc,
+                             const char *const *varyings, int numVaryings,
+                             void (*postCompile)(ShaderSourceSpec *)) {
+    addShaderString(idPtr, name, vertexSrc, NULL, NULL, postCompile);
+    shaderSpecs->feedbackVaryings    = varyings;
+    shaderSpecs->numFeedbackVaryings = numVaryings;
+}
@@ -9,6 +9,11 @@ typedef struct ShaderSourceSpec {
     const char *vertFile; // vertex source file name
     const char *fragFile; // fragment source file name
     const char *geomFile; // geometry source file name
+    int inMemory;         // the "file names" above are GLSL source strings
+    const char *name;     // what to call in-memory shaders in error messages
+    // vertex outputs to capture with transform feedback, interleaved
+    const char *const *feedbackVaryings;
+    int numFeedbackVaryings;
     // handler to call after (re)compilation
     void (*postCompile)(ShaderSourceSpec *);
     // next shader source spec in the list
@@ -24,5 +29,16 @@ void reloadShaders();
 void addShaderSource(GLuint *idPtr, const char *vertexFile,
                      const char *fragmentFile, const char *geometryFile,
                      void (*postCompile)(ShaderSourceSpec *));
+// register in-memory shader source so it is rebuilt along with the others,
+// for modules that don't load files; errors refer to it by name
+void addShaderString(GLuint *idPtr, const char *name, const char *vertexSrc,
+                     const char *fragmentSrc, const char *geometrySrc,
+                     void (*postCompile)(ShaderSourceSpec *));
+// register in-memory vertex-only shader whose outputs are captured with
+// transform feedback, interleaved in the order given
+void addFeedbackShaderString(GLuint *idPtr, const char *name,
+                             const char *vertexSrc,
+                             const char *const *varyings, int numVaryings,
+                             void (*postCompile)(ShaderSourceSpec *));
 
 #endif
@@ -0,0 +1,174 @@
+/**
+ * trace.c
+ * Timeline profiler.
+ *
+ * Each thread records into its own buffer, so recording never takes a
+ * lock. A buffer is only written by its thread, which publishes each event
+ * by bumping the buffer's count after a release barrier. traceWrite()
+ * reads the counts with an acquire barrier and only looks at events below
+ * them, so it can run while other threads keep recording. Buffers are
+ * allocated and touched by traceInit(), and a thread claims one with an
+ * atomic increment on its first event, so that first event doesn't stall
+ * on allocation or page faults. That matters on the audio thread, where
+ * a stall is a glitch. Buffers stop recording when full.
+ *
+ * On x86 the clock is the time stamp counter, which is much cheaper to
+ * read than SDL_GetPerformanceCounter(). It's converted to time by
+ * comparing it with the performance counter when the trace is written.
+ */
+
+#include <SDL2/SDL.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "trace.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define TSC_CLOCK 1
+#else
+#define TSC_CLOCK 0
+#endif
+
+enum { TRACE_MAX_THREADS = 32 };
+enum { TRACE_BUFFER_EVENTS = 1 << 17 }; // 2 MiB per thread
+
+// Events are kept small since writing them is most of the cost of a zone.
+// A counter's value takes up a second event after it, whose stamp holds
+// the bits of the double.
+typedef struct TraceEvent {
+    const char *name;
+    Uint64 stamp; // clock ticks since traceInit() << 8 | phase
+} TraceEvent;
+
+typedef struct TraceBuffer {
+    TraceEvent *events;
+    volatile unsigned count; // events published so far
+    unsigned dropped;        // events that didn't fit
+    unsigned thread;         // thread id in the trace
+    const char *name;        // thread name, if set
+} TraceBuffer;
+
+static TraceBuffer buffers[TRACE_MAX_THREADS];
+static SDL_atomic_t numBuffers; // buffers claimed by threads
+static TraceBuffer overflow; // shared by threads past the limit, no events
+static _Thread_local TraceBuffer *localBuffer = NULL;
+
+// clock readings at traceInit()
+static Uint64 startClock   = 0;
+static Uint64 startCounter = 0;
+
+static Uint64 readClock() {
+#if TSC_CLOCK
+    return __rdtsc();
+#else
+    return SDL_GetPerformanceCounter();
+#endif
+}
+
+void traceInit() {
+    for(int i = 0; i < TRACE_MAX_THREADS; i++) {
+        // Touch the memory now so the first use of each page doesn't show
+        // up in the zones as a page fault.
+        size_t size       = sizeof(TraceEvent) * TRACE_BUFFER_EVENTS;
+        buffers[i].events = (TraceEvent *)malloc(size);
+        if(buffers[i].events) {
+            memset(buffers[i].events, 0, size);
+        }
+        buffers[i].thread = (unsigned)i + 1;
+    }
+    startCounter = SDL_GetPerformanceCounter();
+    startClock   = readClock();
+}
+
+static TraceBuffer *claimBuffer() {
+    int index = SDL_AtomicAdd(&numBuffers, 1);
+    return index < TRACE_MAX_THREADS ? &buffers[index] : &overflow;
+}
+
+void traceEvent(const char *name, char phase, double value) {
+    TraceBuffer *buffer = localBuffer;
+    if(!buffer) {
+        buffer = localBuffer = claimBuffer();
+    }
+    // Leave room for a counter's value either way, it's simpler.
+    unsigned count = buffer->count;
+    if(count + 2 > TRACE_BUFFER_EVENTS || !buffer->events) {
+        buffer->dropped++;
+        return;
+    }
+    TraceEvent *event = &buffer->events[count];
+    event->name       = name;
+    event->stamp      = (readClock() - startClock) << 8 | (Uint8)phase;
+    if(phase == 'C') {
+        event[1].name = NULL;
+        memcpy(&event[1].stamp, &value, sizeof(double));
+        count++;
+    }
+    SDL_MemoryBarrierRelease();
+    buffer->count = count + 1;
+}
+
+void traceThreadName(const char *name) {
+    if(!localBuffer) {
+        localBuffer = claimBuffer();
+    }
+    localBuffer->name = name;
+}
+
+int traceWrite(const char *filename) {
+    FILE *file = fopen(filename, "w");
+    if(!file) {
+        fprintf(stderr, "can't open %s for writing\n", filename);
+        return -1;
+    }
+    // Find out how fast the clock ticks over the whole trace so far.
+    Uint64 counter       = SDL_GetPerformanceCounter() - startCounter;
+    Uint64 clock         = readClock() - startClock;
+    double seconds       = (double)counter / SDL_GetPerformanceFrequency();
+    double microsPerTick = clock > 0 ? seconds * 1e6 / clock : 0;
+
+    fprintf(file, "{\"traceEvents\":[\n");
+    int written = 0, dropped = 0;
+    int count   = SDL_AtomicGet(&numBuffers);
+    for(int i = 0; i < count && i < TRACE_MAX_THREADS; i++) {
+        TraceBuffer *buffer = &buffers[i];
+        unsigned events     = buffer->count;
+        SDL_MemoryBarrierAcquire();
+        fprintf(file,
+                "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                "\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                written ? ",\n" : "", buffer->thread,
+                buffer->name ? buffer->name : "thread");
+        written++;
+        for(unsigned j = 0; j < events; j++) {
+            TraceEvent *event = &buffer->events[j];
+            char phase        = (char)(event->stamp & 0xff);
+            double micros     = (double)(event->stamp >> 8) * microsPerTick;
+            fprintf(file,
+                    ",\n{\"ph\":\"%c\",\"pid\":1,\"tid\":%u,"
+                    "\"ts\":%.3f",
+                    phase, buffer->thread, micros);
+            if(event->name) {
+                fprintf(file, ",\"name\":\"%s\"", event->name);
+            }
+            if(phase == 'C') {
+                double value;
+                memcpy(&value, &event[1].stamp, sizeof(double));
+                fprintf(file, ",\"args\":{\"value\":%g}", value);
+                j++;
+            }
+            fprintf(file, "}");
+            written++;
+        }
+        dropped += buffer->dropped;
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(file);
+    printf("wrote %d trace events to %s", written, filename);
+    if(dropped) {
+        printf(", %d didn't fit in the buffers", dropped);
+    }
+    printf("\n");
+    return written;
+}
@@ -0,0 +1,44 @@
+#ifndef CUBES_TRACE_H
+#define CUBES_TRACE_H
+
+// Timeline profiler. Zones and counters are recorded into a buffer per
+// thread and written out as Chrome trace event JSON, which can be opened
+// in chrome://tracing or https://ui.perfetto.dev .
+// Build with `make TRACE=1` to enable it. Otherwise the macros compile to
+// nothing, so they can stay in hot code.
+// Names must be string literals (or otherwise live until the trace is
+// written), since only the pointers are recorded.
+
+#ifndef CUBES_TRACE
+#define CUBES_TRACE 0
+#endif
+
+#if CUBES_TRACE
+// start the clock; call before anything else
+#define TRACE_INIT() traceInit()
+// start and end a zone on the calling thread; zones nest
+#define TRACE_BEGIN(name) traceEvent(name, 'B', 0)
+#define TRACE_END() traceEvent(NULL, 'E', 0)
+// record a value that changes over time
+#define TRACE_COUNTER(name, value) traceEvent(name, 'C', value)
+// name the calling thread in the trace
+#define TRACE_THREAD(name) traceThreadName(name)
+// write everything recorded so far to a file
+#define TRACE_WRITE(filename) traceWrite(filename)
+#else
+#define TRACE_INIT() ((void)0)
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END() ((void)0)
+#define TRACE_COUNTER(name, value) ((void)0)
+#define TRACE_THREAD(name) ((void)0)
+#define TRACE_WRITE(filename) ((void)0)
+#endif
+
+void traceInit();
+// record an event; phase is 'B' (begin), 'E' (end) or 'C' (counter)
+void traceEvent(const char *name, char phase, double value);
+void traceThreadName(const char *name);
+// return the number of events written, or -1 on error
+int traceWrite(const char *filename);
+
+#endif
@@ -0,0 +1,37 @@
+#define GLEW_STATIC
+#include <GL/glew.h>
+#include <assert.h>
+#include "uniforms.h"
+
+static unsigned alignUp(unsigned size, unsigned align) {
+    return size + (align - (size % align)) % align;
+}
+
+unsigned upBlockSize(unsigned size, unsigned align) {
+    return alignUp(size, align);
+}
+
+void upBegin(UniformPacker *up, RingBuffer *ring, unsigned reserve,
+             unsigned align) {
+    up->ring     = ring;
+    up->reserved = reserve;
+    up->used     = 0;
+    up->align    = align;
+    // Only the start of the write is known to be aligned, so everything
+    // is placed relative to it.
+    ringReserve(ring, reserve);
+    up->data = (unsigned char *)ringBeginWrite(ring, reserve, align,
+                                               &up->offset);
+}
+
+void *upBlock(UniformPacker *up, unsigned size, unsigned *offset) {
+    unsigned start = alignUp(up->used, up->align);
+    assert(start + size <= up->reserved);
+    up->used = start + size;
+    *offset  = up->offset + start;
+    return up->data + start;
+}
+
+void upEnd(UniformPacker *up) {
+    ringEndWrite(up->ring, up->used);
+}
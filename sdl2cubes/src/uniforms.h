@@ -0,0 +1,30 @@
+#ifndef CUBES_UNIFORMS_H
+#define CUBES_UNIFORMS_H
+
+#include "ringbuffer.h"
+
+// Packs the uniform data of a pass into a single ring buffer write.
+// Blocks that get bound on their own have to start at offsets aligned to
+// GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT (often 256 bytes), which wastes most
+// of the space for small blocks, so per-object data goes into one tightly
+// packed block that shaders index instead of a block per object.
+typedef struct UniformPacker {
+    RingBuffer *ring;
+    unsigned char *data; // mapped memory of the write
+    unsigned offset;     // buffer offset of the write
+    unsigned reserved;   // bytes reserved for the write
+    unsigned used;       // bytes taken up so far
+    unsigned align;      // alignment of bound offsets
+} UniformPacker;
+
+// get the space a block of size bytes takes in a packer
+unsigned upBlockSize(unsigned size, unsigned align);
+// start packing up to reserve bytes into a ring
+void upBegin(UniformPacker *up, RingBuffer *ring, unsigned reserve,
+             unsigned align);
+// allocate a block that is bound by itself; return pointer to fill in
+void *upBlock(UniformPacker *up, unsigned size, unsigned *offset);
+// finish the write; only the bytes actually used are uploaded
+void upEnd(UniformPacker *up);
+
+#endif
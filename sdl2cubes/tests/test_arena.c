@@ -0,0 +1,50 @@
+#include "../src/arena.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+static int failed = 0;
+
+static void expect(int ok, const char *what) {
+    if(!ok) {
+        printf("%s\n", what);
+        failed = 1;
+    }
+}
+
+// Checks alignment, overflow into the heap and growing on reset, and that
+// a double-buffered arena keeps allocations alive for two frames.
+int main() {
+    Arena arena;
+    arenaInit(&arena, "test", 256, 2);
+    arena.poison = 1;
+
+    unsigned char *kept = NULL;
+    for(int frame = 0; frame < 8; frame++) {
+        arenaReset(&arena);
+        // The previous frame's allocation must still be intact.
+        if(kept) {
+            expect(kept[0] == frame - 1 && kept[99] == frame - 1,
+                   "double-buffered data was overwritten");
+        }
+        for(unsigned align = 1; align <= 64; align *= 2) {
+            void *p = arenaAlloc(&arena, 3, align);
+            expect((uintptr_t)p % align == 0, "allocation is not aligned");
+        }
+        // more than the initial block, so the first frames overflow
+        unsigned char *big = (unsigned char *)arenaAlloc(&arena, 1000, 16);
+        memset(big, 0xab, 1000);
+        kept = (unsigned char *)arenaAlloc(&arena, 100, 4);
+        memset(kept, frame, 100);
+    }
+    expect(arena.blocks[0].size >= 1000 && arena.blocks[1].size >= 1000,
+           "arena did not grow");
+    expect(arena.blocks[0].overflow == NULL &&
+               arena.blocks[1].overflow == NULL,
+           "arena still overflows after growing");
+    expect(arena.highWater >= 1100, "high water mark is too low");
+    arenaFree(&arena);
+
+    printf("%s\n", failed ? "FAIL" : "OK");
+    return failed;
+}
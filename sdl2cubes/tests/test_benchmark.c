@@ -0,0 +1,60 @@
+#include "../src/benchmark.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static int failed = 0;
+
+static void check(const char *what, double got, double expected) {
+    if(fabs(got - expected) > 1e-4) {
+        printf("%s: got %g, expected %g\n", what, got, expected);
+        failed = 1;
+    }
+}
+
+// Feeds a benchmark slow warmup frames and then the frame times 1..100 ms
+// in a scrambled order, and checks the statistics against what they
+// should be.
+int main() {
+    Benchmark bm;
+    bmInit(&bm, 100);
+    for(int i = 0; i < BM_WARMUP_FRAMES; i++) {
+        if(bmAddFrame(&bm, 1000.0f, 1000, 1000)) {
+            printf("done during warmup\n");
+            failed = 1;
+        }
+    }
+    int done = 0;
+    for(int i = 0; i < 100; i++) {
+        // 37 and 100 are coprime, so this visits every frame time once.
+        int ms = (i * 37) % 100 + 1;
+        done   = bmAddFrame(&bm, (float)ms, ms, ms * 2);
+    }
+    if(!done) {
+        printf("not done after all frames\n");
+        failed = 1;
+    }
+    // Frames after the end are ignored.
+    bmAddFrame(&bm, 5000.0f, 5000, 5000);
+
+    BenchmarkStats s = bmGetStats(&bm);
+    check("frames", s.frames, 100);
+    check("seconds", s.seconds, 5.05);
+    check("mean", s.mean, 50.5);
+    check("min", s.min, 1);
+    check("p50", s.p50, 50);
+    check("p90", s.p90, 90);
+    check("p95", s.p95, 95);
+    check("p99", s.p99, 99);
+    check("max", s.max, 100);
+    check("draw calls", s.drawCalls, 50.5);
+    check("max draw calls", s.maxDrawCalls, 100);
+    check("upload bytes", s.uploadBytes, 101);
+    check("total upload bytes", s.totalUploadBytes, 10100);
+    if(bmPeakRSS() == 0) {
+        printf("warning: peak RSS is unknown on this platform\n");
+    }
+    bmFree(&bm);
+    printf("%s\n", failed ? "FAIL" : "OK");
+    return failed;
+}
@@ -0,0 +1,59 @@
+#include "../src/dynres.h"
+#include <stdio.h>
+
+// Simulates a GPU whose frame time is a fixed part plus a part that
+// follows the number of pixels, with results arriving a few frames late
+// like timer queries do, and checks that the scale settles where the
+// frames fit the budget without going back and forth.
+static float gpuMillis(float fixed, float perPixels, float scale) {
+    return fixed + perPixels * scale * scale;
+}
+
+static int run(const char *name, float fixed, float perPixels, float budget,
+               float expectMin, float expectMax) {
+    enum { LATENCY = 4, FRAMES = 2000 };
+    DynamicResolution dr;
+    drInit(&dr, budget, DR_MIN_SCALE);
+    float pending[LATENCY];
+    for(int i = 0; i < LATENCY; i++) {
+        pending[i] = -1; // no results yet
+    }
+    unsigned changesAt1000 = 0;
+    for(int frame = 0; frame < FRAMES; frame++) {
+        drAddFrame(&dr, pending[frame % LATENCY]);
+        pending[frame % LATENCY] = gpuMillis(fixed, perPixels, dr.scale);
+        if(frame == FRAMES / 2) {
+            changesAt1000 = dr.changes;
+        }
+    }
+    int failed = 0;
+    if(dr.scale < expectMin || dr.scale > expectMax) {
+        printf("%s: settled at scale %.3f, expected %.3f to %.3f\n", name,
+               dr.scale, expectMin, expectMax);
+        failed = 1;
+    }
+    if(dr.changes != changesAt1000) {
+        printf("%s: scale still changing after %d frames\n", name,
+               FRAMES / 2);
+        failed = 1;
+    }
+    if(dr.scale * DR_STEPS != (float)(int)(dr.scale * DR_STEPS)) {
+        printf("%s: scale %f is not a whole step\n", name, dr.scale);
+        failed = 1;
+    }
+    return failed;
+}
+
+int main() {
+    int failed = 0;
+    // Fits at full scale: nothing changes.
+    failed |= run("light", 1, 5, 16.6f, 1, 1);
+    // Needs about 60% of the pixels.
+    failed |= run("heavy", 1, 25, 16.6f, 0.6f, 0.85f);
+    // Can't fit even at the smallest scale, which it stays at.
+    failed |= run("hopeless", 20, 40, 16.6f, DR_MIN_SCALE, DR_MIN_SCALE);
+    // Without a budget the scale never changes.
+    failed |= run("off", 1, 100, 0, 1, 1);
+    printf("%s\n", failed ? "FAIL" : "OK");
+    return failed;
+}
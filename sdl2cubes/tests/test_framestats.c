@@ -0,0 +1,56 @@
+#include "../src/framestats.h"
+#include <math.h>
+#include <stdio.h>
+
+static int failed = 0;
+
+static void expectNear(float value, float expected, const char *what) {
+    if(fabsf(value - expected) > FT_BUCKET_MS) {
+        printf("%s: got %.3f, expected %.3f\n", what, value, expected);
+        failed = 1;
+    }
+}
+
+// Feeds frame times with known percentiles through the window, then
+// checks that frames pushed out of the window no longer count.
+int main() {
+    FrameTimes ft;
+    ftInit(&ft);
+
+    // 1..100 ms in a shuffled order, ten times over.
+    for(int round = 0; round < 10; round++) {
+        for(int i = 0; i < 100; i++) {
+            ftAdd(&ft, (float)(i * 37 % 100 + 1));
+        }
+    }
+    FrameTimeStats stats = ftGetStats(&ft);
+    if(stats.frames != 1000) {
+        printf("window has %u frames, expected 1000\n", stats.frames);
+        failed = 1;
+    }
+    expectNear(stats.mean, 50.5f, "mean");
+    expectNear(stats.p50, 50.0f, "p50");
+    expectNear(stats.p95, 95.0f, "p95");
+    expectNear(stats.p99, 99.0f, "p99");
+    expectNear(stats.max, 100.0f, "max");
+
+    // A steady 16 ms with a few long frames pushes everything else out.
+    for(int i = 0; i < FT_WINDOW; i++) {
+        ftAdd(&ft, i % 256 == 255 ? 50.0f : 16.0f);
+    }
+    stats = ftGetStats(&ft);
+    expectNear(stats.p50, 16.0f, "steady p50");
+    expectNear(stats.p99, 16.0f, "steady p99");
+    expectNear(stats.max, 50.0f, "steady max");
+    if(stats.stutters != FT_WINDOW / 256) {
+        printf("%u stutters in the window, expected %u\n", stats.stutters,
+               FT_WINDOW / 256);
+        failed = 1;
+    }
+    if(stats.totalStutters < FT_WINDOW / 256) {
+        printf("only %u stutters in total\n", stats.totalStutters);
+        failed = 1;
+    }
+    printf("%s\n", failed ? "FAIL" : "OK");
+    return failed;
+}
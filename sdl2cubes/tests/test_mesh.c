@@ -22,9 +22,12 @@ int main(int argc, char *args[]) {
     unsigned numFloats   = meshGetNumFloats(mesh);
     unsigned numVertices = meshGetNumVertices(mesh);
 
-    float *buf = malloc(sizeof(float) * numFloats);
+    float *buf        = malloc(sizeof(float) * numFloats);
+    unsigned *indices = malloc(sizeof(unsigned) * numVertices);
     meshPackVertices(mesh, buf);
+    meshPackIndexed(mesh, buf, indices);
     meshClose(mesh);
+    free(indices);
     free(buf);
     return 0;
 }
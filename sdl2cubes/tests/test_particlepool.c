@@ -0,0 +1,101 @@
+#include "../src/particlepool.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static float randf(float lo, float hi) {
+    return lo + (hi - lo) * rand() / RAND_MAX;
+}
+
+static double now() {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1e6;
+}
+
+// Updates random particles and checks them against a plain C version of
+// the update, then checks that compacting removes exactly the dead ones.
+// Finally times the update on one thread.
+int main(int argc, char *args[]) {
+    unsigned count = argc > 1 ? (unsigned)atoi(args[1]) : 1000000;
+    ParticlePool pool;
+    ppInit(&pool, count);
+
+    srand(1);
+    for(unsigned i = 0; i < count; i++) {
+        float pos[3] = {randf(-1, 1), randf(-1, 1), randf(-1, 1)};
+        float vel[3] = {randf(-5, 5), randf(-5, 5), randf(-5, 5)};
+        ppSpawn(&pool, pos, vel, randf(0.01f, 2));
+    }
+    ParticleForces forces = {{0, -9.8f, 0}, 0.5f, -0.5f, 0.8f};
+    float dt              = 1 / 60.0f;
+
+    int failed = 0;
+    ParticlePool ref;
+    ppInit(&ref, count);
+    for(unsigned i = 0; i < count; i++) {
+        float pos[3] = {pool.x[i], pool.y[i], pool.z[i]};
+        float vel[3] = {pool.vx[i], pool.vy[i], pool.vz[i]};
+        ppSpawn(&ref, pos, vel, pool.life[i]);
+    }
+    ppUpdateRange(&pool, &forces, dt, 0, count);
+    float damp = 1 - forces.drag * dt;
+    for(unsigned i = 0; i < count && !failed; i++) {
+        float vx = (ref.vx[i] + forces.gravity[0] * dt) * damp;
+        float vy = (ref.vy[i] + forces.gravity[1] * dt) * damp;
+        float vz = (ref.vz[i] + forces.gravity[2] * dt) * damp;
+        float x  = ref.x[i] + vx * dt;
+        float y  = ref.y[i] + vy * dt;
+        float z  = ref.z[i] + vz * dt;
+        if(y < forces.floorY) {
+            y  = forces.floorY;
+            vy = -vy * forces.bounce;
+        }
+        float expect[7] = {x, y, z, vx, vy, vz, dt};
+        float got[7]    = {pool.x[i],  pool.y[i],  pool.z[i],  pool.vx[i],
+                        pool.vy[i], pool.vz[i], pool.age[i]};
+        for(int c = 0; c < 7; c++) {
+            if(fabsf(expect[c] - got[c]) > 1e-5f) {
+                printf("particle %u: component %d is %f, expected %f\n", i,
+                       c, got[c], expect[c]);
+                failed = 1;
+            }
+        }
+    }
+    ppFree(&ref);
+
+    // Age everything by a second; about half should die.
+    unsigned alive = 0;
+    for(unsigned i = 0; i < count; i++) {
+        pool.age[i] += 1;
+        alive += pool.age[i] < pool.life[i];
+    }
+    if(ppCompact(&pool) != alive) {
+        printf("compacted to %u particles, expected %u\n", pool.count,
+               alive);
+        failed = 1;
+    }
+    for(unsigned i = 0; i < pool.count; i++) {
+        if(pool.age[i] >= pool.life[i]) {
+            printf("particle %u is dead after compacting\n", i);
+            failed = 1;
+            break;
+        }
+    }
+
+    // Benchmark with everything alive again.
+    pool.count = count;
+    int frames = 100;
+    double start = now();
+    for(int f = 0; f < frames; f++) {
+        ppUpdateRange(&pool, &forces, dt, 0, pool.count);
+    }
+    double ms = now() - start;
+    printf("%s: %.0f particles/ms on one core\n", ppInstructionSet(),
+           (double)count * frames / ms);
+
+    ppFree(&pool);
+    printf("%s\n", failed ? "FAIL" : "OK");
+    return failed;
+}
@@ -0,0 +1,44 @@
+#include "../src/renderqueue.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// Sorts random render items and checks the result is ordered by key and
+// that items with equal keys kept their queueing order. The queue starts
+// out small, so it has to grow along the way.
+int main(int argc, char *args[]) {
+    unsigned count = argc > 1 ? (unsigned)atoi(args[1]) : 100000;
+    RenderQueue queue;
+    rqInit(&queue, 16);
+
+    srand(1);
+    for(unsigned i = 0; i < count; i++) {
+        RenderItem *item = rqPush(&queue);
+        item->program     = 1 + rand() % 4;
+        item->vertexArray = 1 + rand() % 8;
+        item->texture     = 1 + rand() % 16;
+        item->mesh        = rand() % 4;
+        item->transform   = i;
+        float depth       = (rand() % 64) / 64.0f;
+
+        item->key = rqMakeKey(item->program, item->vertexArray, item->texture,
+                              item->mesh, depth);
+    }
+    RenderItem *scratch = (RenderItem *)malloc(sizeof(RenderItem) * count);
+    rqSort(&queue, scratch);
+    free(scratch);
+
+    int failed = 0;
+    for(unsigned i = 1; i < count; i++) {
+        RenderItem *a = &queue.items[i - 1], *b = &queue.items[i];
+        if(a->key > b->key) {
+            printf("item %u: keys out of order\n", i);
+            failed = 1;
+        } else if(a->key == b->key && a->transform > b->transform) {
+            printf("item %u: sort is not stable\n", i);
+            failed = 1;
+        }
+    }
+    rqFree(&queue);
+    printf("%s\n", failed ? "FAIL" : "OK");
+    return failed;
+}